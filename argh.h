@@ -1,278 +1,2402 @@
 #pragma once
 
 #include <algorithm>
+#include <any>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <fstream>
-#include <iomanip>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <numeric>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
 #include <vector>
 
-class Option {
-public:
-  Option() : parsed(false), required(false) {}
-	virtual ~Option() {};
 
-  virtual std::string getDefault()  = 0;
-	virtual std::string getMessage()  = 0;
-  virtual std::string getName()     = 0;
-  virtual void        setValue(std::string const& val) = 0;
+#if defined(_WIN32)
+#include <io.h>
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
-  bool         getParsed()            { return parsed;   }
-	bool         getRequired()          { return required; }
-	
-  virtual void setParsed(bool parsed) { this->parsed = parsed; }
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
 
-protected:
-  bool parsed, required;
+#if defined(__APPLE__)
+#include <crt_externs.h>
+#elif !defined(_WIN32)
+extern char** environ;
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ARGH_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define ARGH_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+// ARGH_STATS changes the layout of Argh, so builds with it get their own names and can be linked into one
+// program alongside builds without it
+#if defined(ARGH_STATS)
+inline namespace argh_stats {
+#endif
+
+// Turns option text into a value. Specialise this for your own types to skip the stream fallback.
+template<typename T, typename Enable = void>
+struct Converter {
+  static void convert(std::string_view str, T& val) {
+    std::stringstream ss(std::string(str.data(), str.size()));
+    ss >> val;
+  }
 };
 
 template<typename T>
-class OptionImpl : public Option {
-public:
-  OptionImpl(T& var, T default_val, std::string const& name, bool required, std::string const& msg) : var(var)
-  {
-		this->default_val = default_val;
-		this->name = name;
-		this->required = required;
-		this->msg = msg;
-		this->var = default_val;
-	}
-
-  virtual std::string getDefault() { std::stringstream ss; ss << default_val; return ss.str(); }
-  std::string getName() { return name; }
-  std::string getMessage() { return msg; }
-  virtual void setValue(std::string const& val) { std::stringstream ss(val); ss >> var; }
+struct NumberConverter {
+  // Same leniency as stream extraction: leading whitespace and '+' are skipped, junk yields zero, values out
+  // of range saturate, and unsigned types take a minus sign and wrap
+  static void convert(std::string_view str, T& val) {
+    auto first = str.data();
+    auto last  = str.data() + str.size();
+    while (first != last && std::isspace(static_cast<unsigned char>(*first))) { ++first; }
+    bool negative = first != last && *first == '-';
+    if (!negative && first != last && *first == '+') {
+      ++first;
+      if (first != last && *first == '-') { val = T(); return; }
+    } else if (negative && std::is_unsigned<T>::value) {
+      ++first;
+    }
+    auto result = std::from_chars(first, last, val);
+    if (result.ec == std::errc::result_out_of_range) {
+      val = outOfRange(first, result.ptr, negative);
+    } else if (result.ec != std::errc()) {
+      val = T();
+    } else if (negative && std::is_unsigned<T>::value) {
+      val = static_cast<T>(T(0) - val);
+    }
+  }
 
 protected:
-  T default_val;
-  T& var;
-  std::string name;
-  std::string msg;
+  static T outOfRange(char const* first, char const* last, bool negative) {
+    if constexpr (std::is_integral<T>::value) {
+      return negative && std::is_signed<T>::value ? std::numeric_limits<T>::lowest() : std::numeric_limits<T>::max();
+    } else {
+      // Overflow stops at the largest finite value; underflow keeps whatever strtold rounds it to
+      long double v = std::strtold(std::string(first, last).c_str(), nullptr);
+      if (std::fabs(v) > std::numeric_limits<T>::max()) {
+        return v < 0 ? std::numeric_limits<T>::lowest() : std::numeric_limits<T>::max();
+      }
+      return static_cast<T>(v);
+    }
+  }
 };
 
-class OptionStringImpl : public OptionImpl<std::string>
-{
-public:
-  OptionStringImpl(std::string& var, std::string const& default_val, std::string const& name, bool required, std::string const& msg) :
-    OptionImpl(var, default_val, name, required, msg)
-  {}
+// Single-byte integers (bool, char) are left out so they keep their own semantics
+template<typename T>
+struct Converter<T, typename std::enable_if<std::is_integral<T>::value && (sizeof(T) > 1)>::type> : NumberConverter<T> {};
+
+template<typename T>
+struct Converter<T, typename std::enable_if<std::is_floating_point<T>::value>::type> : NumberConverter<T> {};
 
-  std::string getDefault() { std::stringstream ss; ss << "\"" << default_val << "\""; return ss.str(); }
-  void setValue(std::string const& val) { var = val; }
+// The whole of "true" or "false", or otherwise a number that is true when non-zero, the way stream
+// extraction reads one
+template<>
+struct Converter<bool> {
+  static void convert(std::string_view str, bool& val) {
+    while (!str.empty() && std::isspace(static_cast<unsigned char>(str.front()))) { str.remove_prefix(1); }
+    if (str == "true" || str == "false") {
+      val = str == "true";
+      return;
+    }
+    long long number;
+    NumberConverter<long long>::convert(str, number);
+    val = number != 0;
+  }
 };
 
-template<typename T>
-class MultiOptionImpl : public Option
-{
-public:
-  MultiOptionImpl(std::vector<T>& var, std::string const& default_vals, std::string const& name, bool required, std::string const& msg, char delim) : var(var)
-  {
-		this->default_vals = default_vals;
-		this->name = name;
-		this->required = required;
-		this->msg = msg;
-		this->delim = delim;
-    setValue(default_vals);
+template<>
+struct Converter<std::string> {
+  static void convert(std::string_view str, std::string& val) { val.assign(str.data(), str.size()); }
+};
+
+inline unsigned lowestBit(uint64_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long i;
+  if (static_cast<uint32_t>(mask)) { _BitScanForward(&i, static_cast<uint32_t>(mask)); return i; }
+  _BitScanForward(&i, static_cast<uint32_t>(mask >> 32));
+  return i + 32;
+#else
+  return static_cast<unsigned>(__builtin_ctzll(mask));
+#endif
+}
+
+// Calls f with the position of every delim, comparing 16 bytes at a time where SSE2 or NEON is available
+template<typename F>
+void forEachDelim(std::string_view str, char delim, F f) {
+  size_t i = 0;
+#if defined(ARGH_SSE2)
+  __m128i needle = _mm_set1_epi8(delim);
+  for (; i + 16 <= str.size(); i += 16) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<__m128i const*>(str.data() + i));
+    uint64_t mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+    for (; mask; mask &= mask - 1) { f(i + lowestBit(mask)); }
   }
+#elif defined(ARGH_NEON)
+  uint8x16_t needle = vdupq_n_u8(static_cast<uint8_t>(delim));
+  for (; i + 16 <= str.size(); i += 16) {
+    uint8x16_t eq = vceqq_u8(vld1q_u8(reinterpret_cast<uint8_t const*>(str.data() + i)), needle);
+    // No movemask on NEON: narrow to four bits per byte and keep one of them
+    uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0) & 0x8888888888888888ull;
+    for (; mask; mask &= mask - 1) { f(i + lowestBit(mask) / 4); }
+  }
+#endif
+  for (; i < str.size(); ++i) {
+    if (str[i] == delim) { f(i); }
+  }
+}
 
-  std::string getDefault()
-  {
-    std::stringstream ss;
-    ss << "\"";
-    ss << default_vals;
-    ss << "\"";
-    return ss.str();
+inline size_t countDelims(std::string_view str, char delim) {
+  size_t n = 0;
+  forEachDelim(str, delim, [&n](size_t) { ++n; });
+  return n;
+}
+
+// Calls f with each delimited field, dropping the empty field after a trailing delimiter like std::getline
+template<typename F>
+void split(std::string_view str, char delim, F f) {
+  size_t start = 0;
+  forEachDelim(str, delim, [&](size_t end) {
+    f(str.substr(start, end - start));
+    start = end + 1;
+  });
+  if (start < str.size()) {
+    f(str.substr(start));
   }
+}
 
-  std::string getName() { return name; }
-  std::string getMessage() { return msg; }
-  virtual void setValue(std::string const& val) {
+// Conversion and rendering shared by Argh and StaticArgh
+template<typename T>
+void assignList(std::vector<T>& var, std::string_view val, char delim) {
+  if constexpr (std::is_same<T, std::string>::value || std::is_same<T, std::string_view>::value) {
+    // Assign over the elements already there so their buffers are reused
+    size_t n = 0;
+    var.reserve(countDelims(val, delim) + 1);
+    split(val, delim, [&var, &n](std::string_view field) {
+      if (n < var.size()) {
+        var[n] = field;
+      } else {
+        var.emplace_back(field);
+      }
+      ++n;
+    });
+    var.resize(n);
+  } else {
     var.clear();
-    std::stringstream ss(val);
-    T elem;
-    for (std::string val_str; std::getline(ss, val_str, delim);) {
-      std::stringstream st(val_str);
-      st >> elem;
+    var.reserve(countDelims(val, delim) + 1);
+    split(val, delim, [&var](std::string_view field) {
+      T elem;
+      Converter<T>::convert(field, elem);
       var.push_back(elem);
+    });
+  }
+}
+
+// Runs f(0) .. f(n - 1) on n threads, one of them the caller's
+template<typename F>
+void parallelFor(size_t n, F f) {
+  std::vector<std::thread> workers;
+  workers.reserve(n - 1);
+  for (size_t k = 1; k < n; ++k) {
+    workers.emplace_back([&f, k] { f(k); });
+  }
+  f(0);
+  for (auto& w : workers) {
+    w.join();
+  }
+}
+
+// Same result as assignList. The text is cut into one run of whole fields per thread, the runs are
+// counted, and then each thread converts its run straight into its slice of the presized vector.
+template<typename T>
+void assignListParallel(std::vector<T>& var, std::string_view val, char delim, unsigned threads) {
+  std::vector<std::string_view> chunks;
+  size_t start = 0;
+  for (unsigned k = 1; k < threads; ++k) {
+    size_t end = std::min(val.find(delim, std::max(start, val.size() / threads * k)), val.size());
+    end += end < val.size();
+    chunks.push_back(val.substr(start, end - start));
+    start = end;
+  }
+  chunks.push_back(val.substr(start));
+
+  std::vector<size_t> offsets(chunks.size() + 1);
+  parallelFor(chunks.size(), [&](size_t k) {
+    offsets[k + 1] = countDelims(chunks[k], delim) + (!chunks[k].empty() && chunks[k].back() != delim);
+  });
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+  var.resize(offsets.back());
+  parallelFor(chunks.size(), [&](size_t k) {
+    T* out = var.data() + offsets[k];
+    split(chunks[k], delim, [&out](std::string_view field) { Converter<T>::convert(field, *out++); });
+  });
+}
+
+// Set through Argh::setParallelThreshold()
+struct ParallelLists {
+  size_t threshold;  // Lists of at least this many bytes are split across threads, 0 for never
+  unsigned threads;
+};
+
+template<typename T>
+std::string formatDefault(T const& val) { std::stringstream ss; ss << val; return ss.str(); }
+
+inline std::string formatDefault(std::string const& val) { return "\"" + val + "\""; }
+
+// How a type is named in the schema export. Specialise it alongside Converter for your own types.
+template<typename T, typename Enable = void>
+struct TypeName {
+  static std::string name() { return typeid(T).name(); }
+};
+
+template<typename T>
+struct TypeName<T, typename std::enable_if<std::is_integral<T>::value>::type> {
+  static std::string name() {
+    if (std::is_same<T, bool>::value) { return "bool"; }
+    if (std::is_same<T, char>::value) { return "char"; }
+    return (std::is_signed<T>::value ? "int" : "uint") + std::to_string(sizeof(T) * 8);
+  }
+};
+
+template<typename T>
+struct TypeName<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+  static std::string name() { return "float" + std::to_string(sizeof(T) * 8); }
+};
+
+template<>
+struct TypeName<std::string> {
+  static std::string name() { return "string"; }
+};
+
+template<>
+struct TypeName<std::string_view> {
+  static std::string name() { return "string"; }
+};
+
+template<typename T>
+struct TypeName<std::vector<T>> {
+  static std::string name() { return "list<" + TypeName<T>::name() + ">"; }
+};
+
+// Escapes for a JSON string, quotes included
+inline void appendJson(std::string& out, std::string_view str) {
+  static char const hex[] = "0123456789abcdef";
+  out.push_back('"');
+  for (char c : str) {
+    auto u = static_cast<unsigned char>(c);
+    if (c == '"' || c == '\\') {
+      out.push_back('\\');
+      out.push_back(c);
+    } else if (u < 0x20) {
+      out.append("\\u00");
+      out.push_back(hex[u >> 4]);
+      out.push_back(hex[u & 15]);
+    } else {
+      out.push_back(c);
     }
   }
+  out.push_back('"');
+}
+
+// Column widths are measured as rows are added, so rendering is a single pass with no reformatting
+class Usage {
+public:
+  Usage() : name_space(0), default_space(0), msg_space(0), size(0) {}
+
+  void add(std::string_view name, std::string_view default_val, std::string_view msg, bool required) {
+    name_space    = std::max(name_space,    name.length()        + 1);
+    default_space = std::max(default_space, default_val.length() + 1);
+    msg_space     = std::max(msg_space,     msg.length()         + 1);
+    size += requiredText(required).length() + 1;
+    rows.push_back(Row{ name, default_val, msg, required });
+  }
+
+  std::string str() const {
+    std::string ret;
+    ret.reserve(size + rows.size() * (name_space + default_space + msg_space));
+    render([&ret](std::string_view s) { ret.append(s.data(), s.size()); });
+    return ret;
+  }
+
+  void print(std::ostream& os) const {
+    render([&os](std::string_view s) { os.write(s.data(), static_cast<std::streamsize>(s.size())); });
+  }
 
 protected:
-  std::string default_vals;
-  std::vector<T>& var;
-  std::string name;
-  std::string msg;
-  char delim;
+  struct Row {
+    std::string_view name;
+    std::string_view default_val;
+    std::string_view msg;
+    bool             required;
+  };
+
+  static std::string_view requiredText(bool required) { return required ? "REQUIRED" : "NOT REQUIRED"; }
+
+  template<typename Sink>
+  static void column(Sink& sink, std::string_view text, size_t width) {
+    static char const spaces[] = "                                ";
+    sink(text);
+    for (size_t pad = width - text.length(); pad > 0;) {
+      size_t n = std::min(pad, sizeof(spaces) - 1);
+      sink(std::string_view(spaces, n));
+      pad -= n;
+    }
+  }
+
+  template<typename Sink>
+  void render(Sink sink) const {
+    for (auto const& row : rows) {
+      column(sink, row.name,        name_space);
+      column(sink, row.default_val, default_space);
+      column(sink, row.msg,         msg_space);
+      sink(requiredText(row.required));
+      sink("\n");
+    }
+  }
+
+  std::vector<Row> rows;
+  size_t name_space, default_space, msg_space, size;
 };
 
-class MultiOptionStringImpl : public MultiOptionImpl<std::string>
-{
-public:
-  MultiOptionStringImpl(std::vector<std::string>& var, std::string const& default_vals, std::string const& name, bool required, std::string const& msg, char delim) :
-    MultiOptionImpl(var, default_vals, name, required, msg, delim)
-  {}
+// Binary form of values for saveSnapshot/loadSnapshot: raw bytes for trivially copyable types,
+// length-prefixed strings and vectors. Native layout, so a snapshot only suits the binary that wrote it.
+template<typename T, typename Enable = void>
+struct Snapshot {
+  static constexpr bool supported = false;
+  static void save(std::string&, T const&) {}
+  static bool load(std::string_view&, T&) { return false; }
+};
 
-  void setValue(std::string const& val) {
-    var.clear();
-    std::stringstream ss(val);
-    for (std::string val_str; std::getline(ss, val_str, delim);) {
-      var.push_back(val_str);
+template<typename T>
+struct Snapshot<T, typename std::enable_if<std::is_trivially_copyable<T>::value>::type> {
+  static constexpr bool supported = true;
+  static void save(std::string& out, T const& val) { out.append(reinterpret_cast<char const*>(&val), sizeof(T)); }
+  static bool load(std::string_view& in, T& val) { return loadBytes(in, &val, sizeof(T)); }
+
+  static bool loadBytes(std::string_view& in, void* dst, size_t size) {
+    if (in.size() < size) { return false; }
+    std::memcpy(dst, in.data(), size);
+    in.remove_prefix(size);
+    return true;
+  }
+};
+
+template<>
+struct Snapshot<std::string> {
+  static constexpr bool supported = true;
+
+  static void save(std::string& out, std::string const& val) {
+    Snapshot<uint64_t>::save(out, val.size());
+    out.append(val);
+  }
+
+  static bool load(std::string_view& in, std::string& val) {
+    uint64_t size;
+    if (!Snapshot<uint64_t>::load(in, size) || in.size() < size) { return false; }
+    val.assign(in.data(), static_cast<size_t>(size));
+    in.remove_prefix(static_cast<size_t>(size));
+    return true;
+  }
+};
+
+template<typename T>
+struct Snapshot<std::vector<T>> {
+  static constexpr bool supported = Snapshot<T>::supported;
+
+  static void save(std::string& out, std::vector<T> const& val) {
+    Snapshot<uint64_t>::save(out, val.size());
+    if constexpr (std::is_trivially_copyable<T>::value) {
+      out.append(reinterpret_cast<char const*>(val.data()), val.size() * sizeof(T));
+    } else {
+      for (auto const& elem : val) { Snapshot<T>::save(out, elem); }
+    }
+  }
+
+  static bool load(std::string_view& in, std::vector<T>& val) {
+    uint64_t size;
+    if (!Snapshot<uint64_t>::load(in, size) || size > in.size()) { return false; }
+    val.resize(static_cast<size_t>(size));
+    if constexpr (std::is_trivially_copyable<T>::value) {
+      return Snapshot<uint64_t>::loadBytes(in, val.data(), val.size() * sizeof(T));
+    } else {
+      for (auto& elem : val) {
+        if (!Snapshot<T>::load(in, elem)) { return false; }
+      }
+      return true;
     }
   }
 };
 
-class FlagImpl : public Option {
+// No data() to copy from, so one byte per element
+template<>
+struct Snapshot<std::vector<bool>> {
+  static constexpr bool supported = true;
+
+  static void save(std::string& out, std::vector<bool> const& val) {
+    Snapshot<uint64_t>::save(out, val.size());
+    for (bool elem : val) { out.push_back(elem ? 1 : 0); }
+  }
+
+  static bool load(std::string_view& in, std::vector<bool>& val) {
+    uint64_t size;
+    if (!Snapshot<uint64_t>::load(in, size) || size > in.size()) { return false; }
+    val.resize(static_cast<size_t>(size));
+    for (size_t i = 0; i < val.size(); ++i) { val[i] = in[i] != 0; }
+    in.remove_prefix(val.size());
+    return true;
+  }
+};
+
+// One value to convert for a batch parse: the command line it came from and its text
+struct BatchCell {
+  size_t           row;
+  std::string_view text;
+};
+
+// Dense bits indexed by option id, so questions about every option are a few word operations
+class Bitset {
 public:
-  FlagImpl(bool& flag, std::string const& name, std::string const& msg) :
-    flag(flag),
-    name(name),
-    msg(msg)
-  {
-    flag = false;
+  void resize(size_t bits) { words.resize((bits + 63) / 64, 0); }
+  void clear() { std::fill(words.begin(), words.end(), 0); }
+
+  bool test(size_t i) const { return (words[i / 64] >> (i % 64)) & 1; }
+
+  void set(size_t i, bool on) {
+    uint64_t bit = uint64_t(1) << (i % 64);
+    words[i / 64] = on ? words[i / 64] | bit : words[i / 64] & ~bit;
   }
 
-  std::string getDefault() { return ""; }
-  std::string getName() { return name; }
-  std::string getMessage() { return msg; }
-  void setParsed(bool parsed) { Option::setParsed(parsed); flag = parsed; }
-  void setValue(std::string const& val) {}
+  // Both sized for the same options
+  bool subsetOf(Bitset const& other) const {
+    for (size_t w = 0; w < words.size(); ++w) {
+      if (words[w] & ~other.words[w]) { return false; }
+    }
+    return true;
+  }
+
+  // Calls f with each bit set here but not in other
+  template<typename F>
+  void forEachNotIn(Bitset const& other, F f) const {
+    for (size_t w = 0; w < words.size(); ++w) {
+      for (uint64_t mask = words[w] & ~other.words[w]; mask; mask &= mask - 1) {
+        f(w * 64 + lowestBit(mask));
+      }
+    }
+  }
 
 protected:
-  bool& flag;
-  std::string name;
-  std::string msg;
+  std::vector<uint64_t> words;
 };
 
-class Argh {
+class Option {
+  friend class Argh;
+
 public:
-  Argh(char delim = ',') : delim(delim) {}
-  ~Argh() { for (auto o : options) { delete o; } options.clear(); }
+  Option() : required(false), default_cached(false), id(0), parsed_bits(nullptr) {}
+	virtual ~Option() {};
 
-  void parse(int argc, char const* argv[]) {
-    for (int i = 0; i < argc; ++i) {
-      for (auto o : options) {
-        if (std::string(argv[i]) == o->getName()) {
-          o->setParsed(true);
-          if (i + 1 < argc) {
-            o->setValue(argv[i + 1]);
-          }
-        }
-      }
+  virtual void        setValue(std::string_view val) = 0;
+  virtual bool        takesValue() const { return true; }  // Flags are handed the next token but ignore it
+
+  // Counterparts for parsing into an ArghResult: they only touch the value passed in, never the option
+  virtual std::any    makeValue() const = 0;
+  virtual void        resetValue(std::any& value) const = 0;
+  virtual void        setValue(std::any& value, std::string_view val) const = 0;
+  virtual void        markParsed(std::any&) const {}
+
+  // And for an ArghBatch: a std::vector with a default value per command line, reusing the one from the last batch
+  // when there is one, then every value for this option converted in one go
+  virtual void        resetColumn(std::any& column, size_t rows) const = 0;
+  virtual void        fillColumn(std::any& column, std::vector<bool> const& parsed, std::vector<BatchCell> const& cells) const = 0;
+
+  // Back to the registered default, assigning over the bound variable so its storage is reused
+  virtual void        reset() { setParsed(false); }
+
+  virtual std::type_info const& getType() const = 0;
+  virtual std::string getTypeName() const = 0;
+  virtual void const* getValue() const = 0;  // The bound variable, of getType()
+  virtual bool        canSnapshot() const = 0;
+  virtual void        saveValue(std::string& out) const = 0;
+  virtual bool        loadValue(std::string_view& in) = 0;
+
+  // Defaults can't change after registration, so they are rendered once on first request
+  std::string_view getDefault() {
+    if (!default_cached) {
+      default_str = renderDefault();
+      default_cached = true;
     }
+    return default_str;
   }
+
+  // Names and messages are views; whoever constructs the option keeps the characters alive
+  std::string_view getName() const    { return name;     }
+  std::string_view getMessage() const { return msg;      }
+  bool         getParsed()            { return parsed_bits && parsed_bits->test(id); }
+	bool         getRequired()          { return required; }
+  size_t       getId() const          { return id;       }
 	
-	void parseEnv() {
-		for (auto o : options) {
-			auto str = getenv(o->getName().c_str());
-			if (str) {
-				o->setParsed(true);
-				o->setValue(str);
-			}
-		}
-	}
+  // Parsed state lives in the owning Argh's bitset; an option on its own never reads as parsed
+  virtual void setParsed(bool parsed) { if (parsed_bits) { parsed_bits->set(id, parsed); } }
 
-  template<typename T>
-  void addOption(T& var, T const& default_val, std::string const& name, bool required = false, std::string const& msg = "") {
-    options.push_back(new OptionImpl<T>(var, default_val, name, required, msg));
-  }
+protected:
+  virtual std::string renderDefault() = 0;
 
-  void addOption(std::string& var, std::string const& default_val, std::string const& name, bool required = false, std::string const& msg = "") {
-    options.push_back(new OptionStringImpl(var, default_val, name, required, msg));
-  }
+  std::string_view name, msg;
+  bool required;
+  std::string default_str;
+  bool default_cached;
+  size_t id;
+  Bitset* parsed_bits;
+};
 
-  template<typename T>
-  void addMultiOption(std::vector<T>& var, std::string const& default_vals, std::string const& name, bool required = false, std::string const& msg = "") {
-    options.push_back(new MultiOptionImpl<T>(var, default_vals, name, required, msg, delim));
+// Open addressing from names to whatever they name: options, or commands
+template<typename T>
+class BasicNameIndex {
+public:
+  BasicNameIndex() : count(0) {}
+
+  void insert(std::string_view name, T* value) {
+    if ((count + 1) * 2 > slots.size()) {
+      grow();
+    }
+    if (place(slots, Slot{ hash(name), name, value })) {
+      ++count;
+    }
   }
 
-  void addMultiOption(std::vector<std::string>& var, std::string const& default_vals, std::string const& name, bool required = false, std::string const& msg = "") {
-    options.push_back(new MultiOptionStringImpl(var, default_vals, name, required, msg, delim));
+  T* find(std::string_view name) const {
+    if (slots.empty()) { return nullptr; }
+    uint64_t h = hash(name);
+    size_t mask = slots.size() - 1;
+    for (size_t i = static_cast<size_t>(h) & mask; slots[i].value; i = (i + 1) & mask) {
+      if (slots[i].hash == h && slots[i].name == name) {
+        return slots[i].value;
+      }
+    }
+    return nullptr;
   }
 
-  void addFlag(bool& flag, std::string const& name, std::string const& msg = "") {
-    options.push_back(new FlagImpl(flag, name, msg));
+  static constexpr uint64_t hash(std::string_view name, uint64_t h = 14695981039346656037ull) {
+    for (char c : name) {
+      h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    return h;
   }
 
-  std::string getUsage() {
-    size_t name_space    = getLongestName()    + 1;
-    size_t default_space = getLongestDefault() + 1;
-    size_t msg_space     = getLongestMessage() + 1;
+protected:
+  struct Slot {
+    uint64_t         hash;
+    std::string_view name;
+    T*               value;
+  };
 
-    std::stringstream ret;
-    ret << std::left;
-    for (auto o : options) {
-      ret
-        << std::setw(static_cast<int>(name_space))    << o->getName()
-        << std::setw(static_cast<int>(default_space)) << o->getDefault()
-        << std::setw(static_cast<int>(msg_space))     << o->getMessage()
-				<< (o->getRequired() ? "REQUIRED" : "NOT REQUIRED")
-        << std::endl;
+  // Linear probing; the first one registered under a name keeps it
+  static bool place(std::vector<Slot>& table, Slot const& slot) {
+    size_t mask = table.size() - 1;
+    size_t i = static_cast<size_t>(slot.hash) & mask;
+    for (; table[i].value; i = (i + 1) & mask) {
+      if (table[i].hash == slot.hash && table[i].name == slot.name) {
+        return false;
+      }
     }
-    return ret.str();
+    table[i] = slot;
+    return true;
   }
 
-  bool isParsed(std::string const& name) {
-    for (auto o : options) {
-      if (name == o->getName() && o->getParsed()) {
-        return true;
-      }
+  void grow() {
+    std::vector<Slot> table(std::max<size_t>(16, slots.size() * 2), Slot{ 0, std::string_view(), nullptr });
+    for (auto const& s : slots) {
+      if (s.value) { place(table, s); }
     }
-    return false;
+    slots.swap(table);
   }
-	
-	std::vector<std::string> missingRequired() {
-		std::vector<std::string> missing;
-    for (auto o : options) {
-      if (o->getRequired() && !o->getParsed())
-				missing.push_back(o->getName());
+
+  std::vector<Slot> slots;
+  size_t count;
+};
+
+using NameIndex = BasicNameIndex<Option>;
+
+// Names in sorted order, so every name starting with a prefix sits in one contiguous run
+class PrefixIndex {
+public:
+  // Merges in options[from..], keeping the first option registered under each name
+  void add(std::vector<Option*> const& options, size_t from) {
+    size_t sorted = names.size();
+    for (size_t i = from; i < options.size(); ++i) {
+      names.push_back(Entry{ options[i]->getName(), options[i] });
     }
-		return missing;
-	}
+    std::stable_sort(names.begin() + sorted, names.end(), less);
+    std::inplace_merge(names.begin(), names.begin() + sorted, names.end(), less);
+    names.erase(std::unique(names.begin(), names.end(), [](Entry const& a, Entry const& b) { return a.name == b.name; }), names.end());
+  }
 
-  bool load(std::string const& filename) {
-    std::ifstream ifs(filename);
-    if (!ifs.good()) { return false; }
-    int argc = 0;
-    std::vector<std::string> argv_str;
-    std::vector<char const*> argv;
-    std::string arg;
-    while (std::getline(ifs, arg)) {
-      argv_str.push_back(arg);
-      ++argc;
+  // The option whose name is prefix, or else the only one starting with it
+  Option* find(std::string_view prefix) const {
+    auto range = run(prefix);
+    if (range.first == range.second) { return nullptr; }
+    if (range.first->name == prefix || range.second - range.first == 1) { return range.first->option; }
+    return nullptr;
+  }
+
+  std::vector<std::string_view> completions(std::string_view prefix) const {
+    std::vector<std::string_view> out;
+    auto range = run(prefix);
+    for (auto i = range.first; i != range.second; ++i) {
+      out.push_back(i->name);
     }
-    for (int i = 0; i < argc; ++i) {
-      argv.push_back(argv_str[i].c_str());
+    return out;
+  }
+
+  // Only names sharing the longest possible prefix with token are compared, at most a window of them
+  std::string_view suggest(std::string_view token) const {
+    const size_t window = 16;
+    for (size_t k = token.size() + 1; k-- > 0;) {
+      auto range = run(token.substr(0, k));
+      if (range.first == range.second) { continue; }
+      auto at = std::lower_bound(range.first, range.second, Entry{ token, nullptr }, less);
+      auto first = at - std::min<ptrdiff_t>(at - range.first, window / 2);
+      auto last = first + std::min<ptrdiff_t>(range.second - first, window);
+      std::string_view best;
+      size_t best_distance = token.size() / 3 + 2;
+      for (auto i = first; i != last; ++i) {
+        size_t d = distance(token, i->name);
+        if (d < best_distance) {
+          best = i->name;
+          best_distance = d;
+        }
+      }
+      return best;
     }
-    parse(argc, &*argv.begin());
-		return true;
+    return std::string_view();
   }
 
 protected:
+  struct Entry {
+    std::string_view name;
+    Option*          option;
+  };
 
-  size_t getLongestName() {
-    size_t ret = 0;
-    for (auto o : options) {
-      ret = std::max(ret, o->getName().length());
-    }
-    return ret;
+  typedef std::vector<Entry>::const_iterator Iterator;
+
+  static bool less(Entry const& a, Entry const& b) { return a.name < b.name; }
+
+  std::pair<Iterator, Iterator> run(std::string_view prefix) const {
+    auto first = std::lower_bound(names.begin(), names.end(), Entry{ prefix, nullptr }, less);
+    auto last = std::partition_point(first, names.end(), [prefix](Entry const& e) { return e.name.compare(0, prefix.size(), prefix) == 0; });
+    return std::make_pair(first, last);
   }
 
-  size_t getLongestDefault() {
-    size_t ret = 0;
-    for (auto o : options) {
-      ret = std::max(ret, o->getDefault().length());
+  // Levenshtein, keeping one row
+  static size_t distance(std::string_view a, std::string_view b) {
+    std::vector<size_t> row(b.size() + 1);
+    std::iota(row.begin(), row.end(), size_t(0));
+    for (size_t i = 1; i <= a.size(); ++i) {
+      size_t diagonal = row[0];
+      row[0] = i;
+      for (size_t j = 1; j <= b.size(); ++j) {
+        size_t above = row[j];
+        row[j] = std::min({ row[j] + 1, row[j - 1] + 1, diagonal + (a[i - 1] != b[j - 1]) });
+        diagonal = above;
+      }
     }
-    return ret;
+    return row[b.size()];
   }
 
-  size_t getLongestMessage() {
-    size_t ret = 0;
-    for (auto o : options) {
-      ret = std::max(ret, o->getMessage().length());
+  std::vector<Entry> names;
+};
+
+// What every single valued option shares: the default, and the hooks that parse into an ArghResult or an
+// ArghBatch instead of the bound variable
+template<typename T>
+class ValueOption : public Option {
+public:
+  using Option::setValue;
+
+  explicit ValueOption(T const& default_val) : default_val(default_val) {}
+
+  std::any makeValue() const { return default_val; }
+  void resetValue(std::any& value) const { *std::any_cast<T>(&value) = default_val; }
+  void setValue(std::any& value, std::string_view val) const { Converter<T>::convert(val, *std::any_cast<T>(&value)); }
+  void resetColumn(std::any& column, size_t rows) const {
+    if (!column.has_value()) { column = std::vector<T>(); }
+    std::any_cast<std::vector<T>>(&column)->assign(rows, default_val);
+  }
+
+  void fillColumn(std::any& column, std::vector<bool> const&, std::vector<BatchCell> const& cells) const {
+    auto& values = *std::any_cast<std::vector<T>>(&column);
+    for (auto const& cell : cells) {
+      // std::vector<bool> hands out proxies, not references
+      if constexpr (std::is_same<T, bool>::value) {
+        bool val;
+        Converter<bool>::convert(cell.text, val);
+        values[cell.row] = val;
+      } else {
+        Converter<T>::convert(cell.text, values[cell.row]);
+      }
     }
-    return ret;
   }
+  std::type_info const& getType() const { return typeid(T); }
+  std::string getTypeName() const { return TypeName<T>::name(); }
 
-  std::vector<Option*> options;
-  char delim;
+protected:
+  std::string renderDefault() { return formatDefault(default_val); }
+
+  T default_val;
+};
+
+template<typename T>
+class OptionImpl : public ValueOption<T> {
+public:
+  OptionImpl(T& var, T default_val, std::string_view name, bool required, std::string_view msg) :
+    ValueOption<T>(default_val),
+    var(var)
+  {
+		this->name = name;
+		this->required = required;
+		this->msg = msg;
+		this->var = default_val;
+	}
+
+  using ValueOption<T>::setValue;
+  virtual void setValue(std::string_view val) { Converter<T>::convert(val, var); }
+  void reset() { Option::reset(); var = this->default_val; }
+
+  void const* getValue() const { return &var; }
+  bool canSnapshot() const { return Snapshot<T>::supported; }
+  void saveValue(std::string& out) const { Snapshot<T>::save(out, var); }
+  bool loadValue(std::string_view& in) { return Snapshot<T>::load(in, var); }
+
+protected:
+  T& var;
 };
+
+// Keeps the matched text and converts it the first time the value is read, so options that are set but
+// never looked at cost a copy of their text and nothing else. Reading is not thread safe.
+template<typename T>
+class LazyOptionImpl : public ValueOption<T> {
+public:
+  LazyOptionImpl(T const& default_val, std::string_view name, bool required, std::string_view msg) :
+    ValueOption<T>(default_val),
+    value(default_val),
+    pending(false)
+  {
+    this->name = name;
+    this->required = required;
+    this->msg = msg;
+  }
+
+  using ValueOption<T>::setValue;
+
+  // The raw buffer's storage is reused from one parse to the next
+  void setValue(std::string_view val) {
+    raw.assign(val.data(), val.size());
+    pending = true;
+  }
+
+  void reset() {
+    Option::reset();
+    value = this->default_val;
+    pending = false;
+  }
+
+  void const* getValue() const {
+    if (pending) {
+      Converter<T>::convert(raw, value);
+      pending = false;
+    }
+    return &value;
+  }
+
+  bool canSnapshot() const { return Snapshot<T>::supported; }
+  void saveValue(std::string& out) const { Snapshot<T>::save(out, *static_cast<T const*>(getValue())); }
+
+  bool loadValue(std::string_view& in) {
+    pending = false;
+    return Snapshot<T>::load(in, value);
+  }
+
+protected:
+  mutable T value;
+  mutable bool pending;
+  std::string raw;
+};
+
+class OptionStringImpl : public OptionImpl<std::string>
+{
+public:
+  OptionStringImpl(std::string& var, std::string const& default_val, std::string_view name, bool required, std::string_view msg) :
+    OptionImpl(var, default_val, name, required, msg)
+  {}
+};
+
+template<typename T>
+class MultiOptionImpl : public Option
+{
+public:
+  MultiOptionImpl(std::vector<T>& var, std::string_view default_vals, std::string_view name, bool required, std::string_view msg, char delim, ParallelLists const* parallel = nullptr) :
+    var(var),
+    parallel(parallel)
+  {
+		this->default_vals = default_vals;
+		this->name = name;
+		this->required = required;
+		this->msg = msg;
+		this->delim = delim;
+    assignList(default_var, this->default_vals, delim);
+    var = default_var;
+  }
+
+  virtual void setValue(std::string_view val) { assign(var, val); }
+  std::any makeValue() const { return default_var; }
+  void resetValue(std::any& value) const { *std::any_cast<std::vector<T>>(&value) = default_var; }
+  void setValue(std::any& value, std::string_view val) const { assign(*std::any_cast<std::vector<T>>(&value), val); }
+  void resetColumn(std::any& column, size_t rows) const {
+    if (!column.has_value()) { column = std::vector<std::vector<T>>(); }
+    auto& values = *std::any_cast<std::vector<std::vector<T>>>(&column);
+    values.resize(rows);
+    std::fill(values.begin(), values.end(), default_var);
+  }
+
+  void fillColumn(std::any& column, std::vector<bool> const&, std::vector<BatchCell> const& cells) const {
+    auto& values = *std::any_cast<std::vector<std::vector<T>>>(&column);
+    for (auto const& cell : cells) {
+      assign(values[cell.row], cell.text);
+    }
+  }
+  void reset() { Option::reset(); var = default_var; }
+
+  std::type_info const& getType() const { return typeid(std::vector<T>); }
+  std::string getTypeName() const { return TypeName<std::vector<T>>::name(); }
+  void const* getValue() const { return &var; }
+  bool canSnapshot() const { return Snapshot<std::vector<T>>::supported; }
+  void saveValue(std::string& out) const { Snapshot<std::vector<T>>::save(out, var); }
+  bool loadValue(std::string_view& in) { return Snapshot<std::vector<T>>::load(in, var); }
+
+protected:
+  std::string renderDefault() { return formatDefault(default_vals); }
+
+  // Only the built in number conversions are known to be safe to run on several threads at once
+  void assign(std::vector<T>& v, std::string_view val) const {
+    if constexpr (std::is_base_of<NumberConverter<T>, Converter<T>>::value) {
+      if (parallel && parallel->threshold && val.size() >= parallel->threshold && parallel->threads > 1) {
+        assignListParallel(v, val, delim, parallel->threads);
+        return;
+      }
+    }
+    assignList(v, val, delim);
+  }
+
+  std::string default_vals;
+  std::vector<T> default_var;
+  std::vector<T>& var;
+  char delim;
+  ParallelLists const* parallel;
+};
+
+class MultiOptionStringImpl : public MultiOptionImpl<std::string>
+{
+public:
+  MultiOptionStringImpl(std::vector<std::string>& var, std::string_view default_vals, std::string_view name, bool required, std::string_view msg, char delim) :
+    MultiOptionImpl(var, default_vals, name, required, msg, delim)
+  {}
+};
+
+// Elements are views into the option's own copy of the last text, so filling the list allocates nothing
+// per element, and setting it again reuses the copy's storage. In an ArghResult they point into the
+// parsed tokens instead.
+class MultiOptionViewImpl : public MultiOptionImpl<std::string_view>
+{
+public:
+  MultiOptionViewImpl(std::vector<std::string_view>& var, std::string_view default_vals, std::string_view name, bool required, std::string_view msg, char delim) :
+    MultiOptionImpl(var, default_vals, name, required, msg, delim)
+  {}
+
+  void setValue(std::string_view val) {
+    text.assign(val.data(), val.size());
+    assignList(var, text, delim);
+  }
+
+  bool canSnapshot() const { return false; }
+
+protected:
+  std::string text;
+};
+
+class FlagImpl : public Option {
+public:
+  FlagImpl(bool& flag, std::string_view name, std::string_view msg) :
+    flag(flag)
+  {
+    this->name = name;
+    this->msg = msg;
+    flag = false;
+  }
+
+  void setParsed(bool parsed) { Option::setParsed(parsed); flag = parsed; }
+  void setValue(std::string_view) {}
+  bool takesValue() const { return false; }
+  std::any makeValue() const { return false; }
+  void resetValue(std::any& value) const { value = false; }
+  void setValue(std::any&, std::string_view) const {}
+  void markParsed(std::any& value) const { value = true; }
+  void resetColumn(std::any& column, size_t) const { if (!column.has_value()) { column = std::vector<bool>(); } }
+  void fillColumn(std::any& column, std::vector<bool> const& parsed, std::vector<BatchCell> const&) const { *std::any_cast<std::vector<bool>>(&column) = parsed; }
+
+  std::type_info const& getType() const { return typeid(bool); }
+  std::string getTypeName() const { return "flag"; }
+  void const* getValue() const { return &flag; }
+  bool canSnapshot() const { return true; }
+  void saveValue(std::string&) const {}
+  bool loadValue(std::string_view&) { return true; }
+
+protected:
+  std::string renderDefault() { return ""; }
+
+  bool& flag;
+};
+
+// Read-only view of a whole file. Empty when the file can't be mapped, so callers fall back to streams.
+class MappedFile {
+public:
+  MappedFile(char const* filename) : data(nullptr), size(0) {
+#if defined(_WIN32)
+    file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    mapping = nullptr;
+    LARGE_INTEGER file_size;
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &file_size) || file_size.QuadPart <= 0) { return; }
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) { return; }
+    data = static_cast<char const*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (data) { size = static_cast<size_t>(file_size.QuadPart); }
+#elif defined(__unix__) || defined(__APPLE__)
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) { return; }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+        data = static_cast<char const*>(p);
+        size = static_cast<size_t>(st.st_size);
+      }
+    }
+    close(fd);
+#else
+    (void)filename;
+#endif
+  }
+
+  ~MappedFile() {
+#if defined(_WIN32)
+    if (data) { UnmapViewOfFile(data); }
+    if (mapping) { CloseHandle(mapping); }
+    if (file != INVALID_HANDLE_VALUE) { CloseHandle(file); }
+#elif defined(__unix__) || defined(__APPLE__)
+    if (data) { munmap(const_cast<char*>(data), size); }
+#endif
+  }
+
+  MappedFile(MappedFile const&) = delete;
+  MappedFile& operator=(MappedFile const&) = delete;
+
+  bool good() const { return data != nullptr; }
+  std::string_view view() const { return std::string_view(data, size); }
+
+protected:
+  char const* data;
+  size_t size;
+#if defined(_WIN32)
+  HANDLE file, mapping;
+#endif
+};
+
+// Modification time and size, or {-1, 0} when there is no such file
+inline std::pair<int64_t, uint64_t> fileStamp(char const* filename) {
+#if defined(_WIN32)
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  if (!GetFileAttributesExA(filename, GetFileExInfoStandard, &data)) { return std::make_pair(int64_t(-1), uint64_t(0)); }
+  return std::make_pair(
+    static_cast<int64_t>((uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime),
+    (uint64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow);
+#elif defined(__unix__) || defined(__APPLE__)
+  struct stat st;
+  if (stat(filename, &st) != 0) { return std::make_pair(int64_t(-1), uint64_t(0)); }
+#if defined(__APPLE__)
+  int64_t nsec = st.st_mtimespec.tv_nsec;
+#else
+  int64_t nsec = st.st_mtim.tv_nsec;
+#endif
+  return std::make_pair(static_cast<int64_t>(st.st_mtime) * 1000000000 + nsec, static_cast<uint64_t>(st.st_size));
+#else
+  (void)filename;
+  return std::make_pair(int64_t(-1), uint64_t(0));
+#endif
+}
+
+inline std::string_view trimLine(std::string_view line) {
+  if (!line.empty() && line.back() == '\r') { line.remove_suffix(1); }
+  return line;
+}
+
+// Calls f with every line of text, without the line endings
+template<typename F>
+void forEachLine(std::string_view text, F f) {
+  while (!text.empty()) {
+    size_t end = std::min(text.find('\n'), text.size());
+    f(trimLine(text.substr(0, end)));
+    text.remove_prefix(std::min(end + 1, text.size()));
+  }
+}
+
+// A response file split into one token per line, the same way load() reads option files. The file is
+// read into memory rather than mapped, so the tokens stay put when the file is rewritten or truncated,
+// and it is closed again straight away.
+class ResponseFile {
+public:
+  ResponseFile(char const* filename) : stamp(fileStamp(filename)) {
+    std::ifstream ifs(filename, std::ios::binary);
+    ok = ifs.good();
+    contents.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    forEachLine(contents, [this](std::string_view line) { tokens.push_back(line); });
+  }
+
+  bool good() const { return ok; }
+  std::vector<std::string_view> const& getTokens() const { return tokens; }
+
+  // With cached set, a file is read once and shared process-wide until its modification time or size changes
+  static std::shared_ptr<ResponseFile const> open(std::string const& filename, bool cached) {
+    if (!cached) { return std::make_shared<ResponseFile const>(filename.c_str()); }
+    auto stamp = fileStamp(filename.c_str());
+    auto& c = cache();
+    std::lock_guard<std::mutex> lock(c.mutex);
+    auto found = c.files.find(filename);
+    if (found != c.files.end() && found->second->stamp == stamp && stamp.first >= 0) { return found->second; }
+    if (found == c.files.end()) { prune(c); }
+    auto& entry = c.files[filename];
+    entry = std::make_shared<ResponseFile const>(filename.c_str());
+    return entry;
+  }
+
+  // Files already handed out stay in memory until the last user lets go
+  static void clearCache() {
+    auto& c = cache();
+    std::lock_guard<std::mutex> lock(c.mutex);
+    c.files.clear();
+  }
+
+protected:
+  struct Cache {
+    std::mutex mutex;
+    std::map<std::string, std::shared_ptr<ResponseFile const>, std::less<>> files;
+  };
+
+  static Cache& cache() {
+    static Cache c;
+    return c;
+  }
+
+  static constexpr size_t max_cached = 64;
+
+  // Before a new name goes in: files that have gone are dropped, and once the cache is full so is
+  // every file no one else holds
+  static void prune(Cache& c) {
+    for (auto it = c.files.begin(); it != c.files.end();) {
+      bool gone = fileStamp(it->first.c_str()).first < 0;
+      it = gone || (c.files.size() >= max_cached && it->second.use_count() == 1) ? c.files.erase(it) : std::next(it);
+    }
+  }
+
+  std::string contents;
+  std::vector<std::string_view> tokens;
+  std::pair<int64_t, uint64_t> stamp;
+  bool ok;
+};
+
+// What the add functions return: the option's id, typed by the value it holds, so it can be
+// looked up with no hashing or name comparisons
+template<typename T>
+struct OptionHandle {
+  size_t id;
+};
+
+// One option as read back from Argh::getSchemaBinary(). The views point into the blob.
+struct SchemaEntry {
+  std::string_view name, type, default_val, msg;
+  bool required;
+};
+
+class ArghResult;
+class ArghBatch;
+
+inline char** environment() {
+#if defined(_WIN32)
+  return _environ;
+#elif defined(__APPLE__)
+  return *_NSGetEnviron();
+#else
+  return environ;
+#endif
+}
+
+// What an Argh has been up to, for checking startup cost. Only collected when ARGH_STATS is defined.
+struct ArghStats {
+  enum Phase { Load, ParseEnv, Parse, Usage, Phases };
+
+  uint64_t calls[Phases] = {};
+  uint64_t nanoseconds[Phases] = {};
+  uint64_t options_matched = 0;
+  uint64_t values_converted = 0;
+  uint64_t bytes_tokenized = 0;
+  uint64_t allocations = 0;  // Heap allocations, as seen by the counter given to setAllocationCounter()
+  uint64_t arena_bytes = 0;  // Taken from the arena's upstream resource
+
+  static char const* phaseName(Phase phase) {
+    static char const* const names[Phases] = { "load", "parseEnv", "parse", "getUsage" };
+    return names[phase];
+  }
+};
+
+class Argh {
+  friend class ArghResult;
+  friend class ArghBatch;
+
+public:
+  // Options and interned strings are carved out of an arena that takes its blocks from upstream
+  Argh(char delim = ',', std::pmr::memory_resource* upstream = std::pmr::get_default_resource()) :
+#if defined(ARGH_STATS)
+    counting(upstream, stats),
+    arena(&counting),
+#else
+    arena(upstream),
+#endif
+    env_index_size(0),
+    prefix_index_size(0),
+    schema_json_size(SIZE_MAX),
+    schema_binary_size(SIZE_MAX),
+    abbreviations(false),
+    response_files(false),
+    response_cache(false),
+    selected(nullptr),
+    delim(delim),
+    parallel{ 0, 0 },
+    staging(false),
+    priority(0)
+  {}
+  ~Argh() { for (auto o : options) { o->~Option(); } options.clear(); }
+
+  // With commands added, the first positional token naming one selects it and everything after it goes to
+  // the command. Positional tokens are neither option names nor an option's value, so a value that happens
+  // to spell a command is still a value, and the program name is passed over.
+  void parse(int argc, char const* argv[]) {
+    Timed timed(*this, ArghStats::Parse);
+    Option* pending = nullptr;
+    selected = nullptr;
+    for (int i = 0; i < argc; ++i) {
+      std::string_view token(argv[i]);
+      count(&ArghStats::bytes_tokenized, token.size());
+      if (!commands.empty() && (!pending || !pending->takesValue()) && !match(token) && !isResponseFile(token) && (selected = findCommand(token))) {
+        build(*selected).parse(argc - i - 1, argv + i + 1);
+        return;
+      }
+      parseArg(pending, token, BoundSink{ *this }, 0);
+    }
+  }
+
+  // Leaves the bound variables and parsed state alone, so any number of threads can share one Argh
+  void parse(ArghResult& result, int argc, char const* argv[]) const;
+
+  // Many command lines in one call, as every token back to back: line i is tokens[offsets[i]] up to tokens[offsets[i + 1]].
+  // All lines are matched first, then each option converts the values it collected in one tight loop.
+  void parse(ArghBatch& batch, std::vector<std::string_view> const& tokens, std::vector<size_t> const& offsets) const;
+	
+  // Walks the environment once, looking variables up by option name as is
+	void parseEnv() {
+    Timed timed(*this, ArghStats::ParseEnv);
+    parseEnv(index, "");
+  }
+
+  // Same, but "--foo-bar" is looked up as <prefix>FOO_BAR
+  void parseEnv(std::string_view prefix) {
+    Timed timed(*this, ArghStats::ParseEnv);
+    for (size_t i = env_index_size; i < options.size(); ++i) {
+      env_index.insert(envName(options[i]->getName()), options[i]);
+    }
+    env_index_size = options.size();
+    parseEnv(env_index, prefix);
+  }
+
+  template<typename T>
+  OptionHandle<T> addOption(T& var, T const& default_val, std::string_view name, bool required = false, std::string_view msg = "") {
+    if constexpr (std::is_same<T, std::string>::value) {
+      return addOption(var, default_val, name, required, msg);
+    } else {
+      return { add<OptionImpl<T>>(var, default_val, intern(name), required, intern(msg)) };
+    }
+  }
+
+  OptionHandle<std::string> addOption(std::string& var, std::string const& default_val, std::string_view name, bool required = false, std::string_view msg = "") {
+    return { add<OptionStringImpl>(var, default_val, intern(name), required, intern(msg)) };
+  }
+
+  template<typename T>
+  OptionHandle<std::vector<T>> addMultiOption(std::vector<T>& var, std::string_view default_vals, std::string_view name, bool required = false, std::string_view msg = "") {
+    if constexpr (std::is_same<T, std::string>::value || std::is_same<T, std::string_view>::value) {
+      return addMultiOption(var, default_vals, name, required, msg);
+    } else {
+      return { add<MultiOptionImpl<T>>(var, default_vals, intern(name), required, intern(msg), delim, &parallel) };
+    }
+  }
+
+  OptionHandle<std::vector<std::string>> addMultiOption(std::vector<std::string>& var, std::string_view default_vals, std::string_view name, bool required = false, std::string_view msg = "") {
+    return { add<MultiOptionStringImpl>(var, default_vals, intern(name), required, intern(msg), delim) };
+  }
+
+  // The views stay valid for as long as this Argh
+  OptionHandle<std::vector<std::string_view>> addMultiOption(std::vector<std::string_view>& var, std::string_view default_vals, std::string_view name, bool required = false, std::string_view msg = "") {
+    return { add<MultiOptionViewImpl>(var, default_vals, intern(name), required, intern(msg), delim) };
+  }
+
+  // A subcommand with options of its own. factory registers them on a fresh Argh, and only runs once the
+  // command is first selected, so commands that aren't used cost nothing beyond their name.
+  void addCommand(std::string_view name, std::function<void(Argh&)> factory, std::string_view msg = "") {
+    commands.push_back(Command{ intern(name), intern(msg), std::move(factory), nullptr });
+    command_index.insert(commands.back().name, &commands.back());
+  }
+
+  // The Argh of the command the last parse() selected, or null when there was none
+  Argh* getCommand() { return selected ? selected->argh.get() : nullptr; }
+  std::string_view getCommandName() const { return selected ? selected->name : std::string_view(); }
+
+  // Rather than binding a variable, keeps the text and converts it when the value is first read through get()
+  template<typename T>
+  OptionHandle<T> addLazyOption(T const& default_val, std::string_view name, bool required = false, std::string_view msg = "") {
+    return { add<LazyOptionImpl<T>>(default_val, intern(name), required, intern(msg)) };
+  }
+
+  OptionHandle<bool> addFlag(bool& flag, std::string_view name, std::string_view msg = "") {
+    return { add<FlagImpl>(flag, intern(name), intern(msg)) };
+  }
+
+  // By handle: a bit test, the bound variable, and putting one option back to its default
+  template<typename T>
+  bool isParsed(OptionHandle<T> handle) const { return parsed_bits.test(handle.id); }
+
+  template<typename T>
+  T const& get(OptionHandle<T> handle) const { return *static_cast<T const*>(options[handle.id]->getValue()); }
+
+  // Null when there is no such option or T isn't its type
+  template<typename T>
+  T const* get(std::string_view name) const {
+    auto o = index.find(name);
+    return o && o->getType() == typeid(T) ? static_cast<T const*>(o->getValue()) : nullptr;
+  }
+
+  template<typename T>
+  void reset(OptionHandle<T> handle) { options[handle.id]->reset(); }
+
+  // GNU style: a "--" token that names no option picks the one option whose name it starts, so --mynum is --mynumber.
+  // Ambiguous abbreviations match nothing.
+  void setAbbreviations(bool abbreviations) {
+    this->abbreviations = abbreviations;
+    if (abbreviations) { prefixes(); }
+  }
+
+  // Every option name starting with prefix, in sorted order
+  std::vector<std::string_view> completions(std::string_view prefix) { return prefixes().completions(prefix); }
+
+  // The closest option name to a mistyped token, or empty when nothing is close
+  std::string_view suggest(std::string_view token) { return prefixes().suggest(token); }
+
+  // parse() then reads an "@path" token as the lines of that file, which may name further response files.
+  // With cached set, each file is read once per process until it changes. Unreadable files are left as tokens.
+  void setResponseFiles(bool expand, bool cached = true) {
+    response_files = expand;
+    response_cache = cached;
+  }
+
+  // Lists of numbers at least this many bytes long are converted on several threads. Off until set.
+  void setParallelThreshold(size_t bytes, unsigned threads = std::thread::hardware_concurrency()) {
+    parallel.threshold = bytes;
+    parallel.threads = threads;
+  }
+
+  std::string getUsage() {
+    Timed timed(*this, ArghStats::Usage);
+    return usage().str();
+  }
+
+  void printUsage(std::ostream& os) {
+    Timed timed(*this, ArghStats::Usage);
+    usage().print(os);
+  }
+
+  // Everything usage shows, for tools, rendered from the option table in one pass. Both forms are kept
+  // until another option is added, so asking again costs nothing. Defaults appear as usage shows them.
+  //   [{"name":"--mynumber","type":"int32","default":"123","required":false,"message":""}]
+  std::string_view getSchemaJson() {
+    if (schema_json_size != options.size()) {
+      schema_json.clear();
+      schema_json.push_back('[');
+      for (auto o : options) {
+        schema_json.append(o == options.front() ? "{\"name\":" : ",{\"name\":");
+        appendJson(schema_json, o->getName());
+        schema_json.append(",\"type\":");
+        appendJson(schema_json, o->getTypeName());
+        schema_json.append(",\"default\":");
+        appendJson(schema_json, o->getDefault());
+        schema_json.append(o->getRequired() ? ",\"required\":true,\"message\":" : ",\"required\":false,\"message\":");
+        appendJson(schema_json, o->getMessage());
+        schema_json.push_back('}');
+      }
+      schema_json.push_back(']');
+      schema_json_size = options.size();
+    }
+    return schema_json;
+  }
+
+  // The same as schema_magic, an option count, then for each option a required byte and its name, type,
+  // default and message, each as a 32-bit length and the bytes. Numbers are in native byte order.
+  std::string_view getSchemaBinary() {
+    if (schema_binary_size != options.size()) {
+      schema_binary.assign(schema_magic.data(), schema_magic.size());
+      Snapshot<uint32_t>::save(schema_binary, static_cast<uint32_t>(options.size()));
+      for (auto o : options) {
+        auto type = o->getTypeName();
+        schema_binary.push_back(o->getRequired() ? 1 : 0);
+        for (auto field : { o->getName(), std::string_view(type), o->getDefault(), o->getMessage() }) {
+          Snapshot<uint32_t>::save(schema_binary, static_cast<uint32_t>(field.size()));
+          schema_binary.append(field.data(), field.size());
+        }
+      }
+      schema_binary_size = options.size();
+    }
+    return schema_binary;
+  }
+
+  // False when the blob is cut short or isn't a schema
+  static bool readSchema(std::string_view blob, std::vector<SchemaEntry>& entries) {
+    uint32_t count;
+    entries.clear();
+    if (blob.compare(0, schema_magic.size(), schema_magic) != 0) { return false; }
+    blob.remove_prefix(schema_magic.size());
+    if (!Snapshot<uint32_t>::load(blob, count)) { return false; }
+    for (uint32_t i = 0; i < count; ++i) {
+      SchemaEntry entry;
+      char required;
+      if (!Snapshot<char>::load(blob, required)) { return false; }
+      entry.required = required != 0;
+      for (auto field : { &entry.name, &entry.type, &entry.default_val, &entry.msg }) {
+        uint32_t size;
+        if (!Snapshot<uint32_t>::load(blob, size) || blob.size() < size) { return false; }
+        *field = blob.substr(0, size);
+        blob.remove_prefix(size);
+      }
+      entries.push_back(entry);
+    }
+    return true;
+  }
+
+  // Restores every bound variable to its default and clears the parsed state, ready for another parse
+  void reset() {
+    for (auto o : options) {
+      o->reset();
+    }
+    for (auto& c : commands) {
+      if (c.argh) { c.argh->reset(); }
+    }
+    selected = nullptr;
+  }
+
+  bool saveSnapshot(std::string const& filename) const { return saveSnapshot(filename.c_str()); }
+  bool saveSnapshot(std::string_view filename) const { return withFilename(filename, [this](char const* f) { return saveSnapshot(f); }); }
+
+  // Writes every option's current value and parsed state, tagged with a hash of the option names and types
+  bool saveSnapshot(char const* filename) const {
+    std::string out(snapshot_magic);
+    Snapshot<uint64_t>::save(out, schemaHash());
+    for (auto o : options) {
+      if (!o->canSnapshot()) { return false; }
+      out.push_back(o->getParsed() ? 1 : 0);
+      o->saveValue(out);
+    }
+    std::ofstream ofs(filename, std::ios::binary);
+    ofs.write(out.data(), static_cast<std::streamsize>(out.size()));
+    return ofs.good();
+  }
+
+  bool loadSnapshot(std::string const& filename) { return loadSnapshot(filename.c_str()); }
+  bool loadSnapshot(std::string_view filename) { return withFilename(filename, [this](char const* f) { return loadSnapshot(f); }); }
+
+  // False when the file is missing or was written for different options, so the text file should be loaded instead.
+  // A snapshot cut short part way through leaves every option at its default.
+  bool loadSnapshot(char const* filename) {
+    MappedFile file(filename);
+    std::string contents;
+    std::string_view in = file.view();
+    if (!file.good()) {
+      std::ifstream ifs(filename, std::ios::binary);
+      contents.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+      in = contents;
+    }
+    uint64_t hash;
+    if (in.compare(0, snapshot_magic.size(), snapshot_magic) != 0) { return false; }
+    in.remove_prefix(snapshot_magic.size());
+    if (!Snapshot<uint64_t>::load(in, hash) || hash != schemaHash()) { return false; }
+    for (auto o : options) {
+      char parsed;
+      if (!Snapshot<char>::load(in, parsed) || !o->loadValue(in)) {
+        reset();
+        return false;
+      }
+      o->setParsed(parsed != 0);
+    }
+    return true;
+  }
+
+  // Layered sources: after stage(priority), load/parse/parseEnv only record raw text. resolve() then
+  // converts the highest priority value for each option once; equal priorities go to the later source.
+  //   argh.stage(1); argh.load("argh.opts"); argh.stage(3); argh.parse(argc, argv); argh.stage(2); argh.parseEnv(); argh.resolve();
+  void stage(int priority) {
+    if (!staging) {
+      for (auto& s : staged) {
+        s.has_value = s.parsed = false;
+      }
+    }
+    staged.resize(options.size());
+    staging = true;
+    this->priority = priority;
+  }
+
+  void resolve() {
+    if (!staging) { return; }
+    staging = false;
+    for (size_t i = 0; i < staged.size() && i < options.size(); ++i) {
+      if (staged[i].parsed) { options[i]->setParsed(true); }
+      if (staged[i].has_value) {
+        options[i]->setValue(staged[i].value);
+        count(&ArghStats::values_converted);
+      }
+    }
+  }
+
+  bool isParsed(std::string_view name) const {
+    auto o = index.find(name);
+    return o && parsed_bits.test(o->getId());
+  }
+
+  bool hasAllRequired() const { return required_bits.subsetOf(parsed_bits); }
+	
+	std::vector<std::string> missingRequired() {
+		std::vector<std::string> missing;
+    required_bits.forEachNotIn(parsed_bits, [&](size_t i) { missing.emplace_back(options[i]->getName()); });
+		return missing;
+	}
+
+  bool load(std::string const& filename) { return load(filename.c_str()); }
+  bool load(std::string_view filename) { return withFilename(filename, [this](char const* f) { return load(f); }); }
+
+  // One token per line. Lines are matched straight out of the mapped file when mapping is possible.
+  bool load(char const* filename) {
+    Timed timed(*this, ArghStats::Load);
+    Option* pending = nullptr;
+    MappedFile file(filename);
+    if (file.good()) {
+      count(&ArghStats::bytes_tokenized, file.view().size());
+      forEachLine(file.view(), [&](std::string_view line) { parseToken(pending, line, BoundSink{ *this }); });
+      return true;
+    }
+    std::ifstream ifs(filename);
+    if (!ifs.good()) { return false; }
+    return load(ifs);
+  }
+
+  // Feeds option text in as it arrives. Lines are applied as soon as they are complete, and only
+  // a line split across two chunks is ever copied, so memory is bounded by the longest line.
+  class Loader {
+  public:
+    Loader(Argh& argh) : argh(argh), pending(nullptr) {}
+
+    void write(std::string_view chunk) {
+      Timed timed(argh, ArghStats::Load);
+      argh.count(&ArghStats::bytes_tokenized, chunk.size());
+      for (size_t end; (end = chunk.find('\n')) != std::string_view::npos; chunk.remove_prefix(end + 1)) {
+        if (partial.empty()) {
+          line(chunk.substr(0, end));
+        } else {
+          partial.append(chunk.data(), end);
+          line(partial);
+          partial.clear();
+        }
+      }
+      partial.append(chunk.data(), chunk.size());
+    }
+
+    // Applies a last line that had no newline
+    void finish() {
+      Timed timed(argh, ArghStats::Load);
+      if (!partial.empty()) {
+        line(partial);
+        partial.clear();
+      }
+    }
+
+  protected:
+    void line(std::string_view text) { argh.parseToken(pending, trimLine(text), BoundSink{ argh }); }
+
+    Argh& argh;
+    Option* pending;
+    std::string partial;
+  };
+
+  // Line by line, so each option is applied as soon as its line has arrived, even from a slow pipe
+  bool load(std::istream& is) {
+    Timed timed(*this, ArghStats::Load);
+    if (!is) { return false; }
+    Option* pending = nullptr;
+    for (std::string line; std::getline(is, line);) {
+      count(&ArghStats::bytes_tokenized, line.size() + (is.eof() ? 0 : 1));
+      parseToken(pending, trimLine(line), BoundSink{ *this });
+    }
+    return !is.bad();
+  }
+
+  bool reload(std::string const& filename, std::function<void(std::string_view)> const& changed = nullptr) {
+    return reload(filename.c_str(), changed);
+  }
+
+  bool reload(std::string_view filename, std::function<void(std::string_view)> const& changed = nullptr) {
+    return withFilename(filename, [&](char const* f) { return reload(f, changed); });
+  }
+
+  // For files that change while the program runs: only options whose raw text differs from the last reload
+  // are set again, options that have gone from the file go back to their defaults, and the rest are left
+  // alone. changed is called with the name of each option touched. The file is read into memory, never
+  // mapped, so a writer truncating it underneath can't fault the read.
+  bool reload(char const* filename, std::function<void(std::string_view)> const& changed = nullptr) {
+    Timed timed(*this, ArghStats::Load);
+    ResponseFile file(filename);
+    if (!file.good()) { return false; }
+    std::vector<std::string_view> values(options.size());
+    std::vector<char> state(options.size(), Absent);
+    Option* pending = nullptr;
+    for (auto token : file.getTokens()) {
+      parseToken(pending, token, RawSink{ values, state });
+    }
+    reloaded.resize(options.size());
+    reloaded_state.resize(options.size(), Absent);
+    for (size_t i = 0; i < options.size(); ++i) {
+      if (state[i] == reloaded_state[i] && (state[i] != HasValue || values[i] == reloaded[i])) { continue; }
+      if (state[i] == Absent || (reloaded_state[i] == HasValue && state[i] != HasValue)) { options[i]->reset(); }
+      if (state[i] != Absent) { options[i]->setParsed(true); }
+      if (state[i] == HasValue) { options[i]->setValue(values[i]); }
+      reloaded[i].assign(values[i].data(), values[i].size());
+      reloaded_state[i] = state[i];
+      if (changed) { changed(options[i]->getName()); }
+    }
+    return true;
+  }
+
+  // Reads until end of input, so pipes and sockets work as well as files
+  bool loadFd(int fd) {
+    Timed timed(*this, ArghStats::Load);
+    Loader loader(*this);
+    char buffer[4096];
+    for (;;) {
+#if defined(_WIN32)
+      auto n = _read(fd, buffer, sizeof(buffer));
+#elif defined(__unix__) || defined(__APPLE__)
+      auto n = read(fd, buffer, sizeof(buffer));
+#else
+      int n = -1;
+      (void)fd;
+#endif
+      if (n < 0 && errno == EINTR) { continue; }
+      if (n < 0) { return false; }
+      if (n == 0) { break; }
+      loader.write(std::string_view(buffer, static_cast<size_t>(n)));
+    }
+    loader.finish();
+    return true;
+  }
+
+#if defined(ARGH_STATS)
+  ArghStats const& getStats() const { return stats; }
+  void resetStats() { stats = ArghStats(); }
+
+  // Called as each top level load, parseEnv, parse or getUsage call returns
+  void setStatsCallback(std::function<void(ArghStats::Phase, ArghStats const&)> callback) { stats_callback = std::move(callback); }
+
+  // A running count of heap allocations, such as one kept by a replaced operator new
+  void setAllocationCounter(uint64_t (*counter)()) { allocation_counter = counter; }
+#endif
+
+protected:
+#if defined(ARGH_STATS)
+  // Times the outermost phase only, so load() falling back to a stream is counted once
+  class Timed {
+  public:
+    Timed(Argh& argh, ArghStats::Phase phase) :
+      argh(argh),
+      phase(phase),
+      outer(argh.depth++ == 0),
+      allocations(argh.allocation_counter ? argh.allocation_counter() : 0),
+      start(std::chrono::steady_clock::now())
+    {}
+
+    ~Timed() {
+      --argh.depth;
+      if (!outer) { return; }
+      auto& stats = argh.stats;
+      ++stats.calls[phase];
+      stats.nanoseconds[phase] += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+      if (argh.allocation_counter) { stats.allocations += argh.allocation_counter() - allocations; }
+      if (argh.stats_callback) { argh.stats_callback(phase, stats); }
+    }
+
+  protected:
+    Argh& argh;
+    ArghStats::Phase phase;
+    bool outer;
+    uint64_t allocations;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  class CountingResource : public std::pmr::memory_resource {
+  public:
+    CountingResource(std::pmr::memory_resource* upstream, ArghStats& stats) : upstream(upstream), stats(stats) {}
+
+  protected:
+    void* do_allocate(size_t bytes, size_t alignment) {
+      stats.arena_bytes += bytes;
+      return upstream->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t alignment) { upstream->deallocate(p, bytes, alignment); }
+    bool do_is_equal(std::pmr::memory_resource const& other) const noexcept { return this == &other; }
+
+    std::pmr::memory_resource* upstream;
+    ArghStats& stats;
+  };
+
+  void count(uint64_t ArghStats::* field, uint64_t n = 1) { stats.*field += n; }
+#else
+  struct Timed {
+    Timed(Argh&, ArghStats::Phase) {}
+  };
+
+  void count(uint64_t ArghStats::*, uint64_t = 1) {}
+#endif
+
+  // Parsed values go straight into the bound variables, unless stage() has them held back for resolve()
+  struct BoundSink {
+    Argh& argh;
+
+    void setValue(Option& o, std::string_view val) {
+      if (!argh.staging) {
+        o.setValue(val);
+        argh.count(&ArghStats::values_converted);
+        return;
+      }
+      auto& s = argh.staged[o.getId()];
+      if (!s.has_value || argh.priority >= s.priority) {
+        s.value.assign(val.data(), val.size());
+        s.priority = argh.priority;
+        s.has_value = true;
+      }
+    }
+
+    void setParsed(Option& o) {
+      argh.count(&ArghStats::options_matched);
+      if (!argh.staging) { o.setParsed(true); return; }
+      argh.staged[o.getId()].parsed = true;
+    }
+
+    // Bound values never point into the tokens, so the file can go once it has been parsed
+    void keep(std::shared_ptr<ResponseFile const> const&) {}
+  };
+
+  struct Command {
+    std::string_view name, msg;
+    std::function<void(Argh&)> factory;
+    std::unique_ptr<Argh> argh;
+  };
+
+  Command* findCommand(std::string_view token) { return command_index.find(token); }
+
+  // The command starts out with this Argh's settings as they are when it is first selected
+  Argh& build(Command& c) {
+    if (!c.argh) {
+      c.argh.reset(new Argh(delim, arena.upstream_resource()));
+      c.argh->setResponseFiles(response_files, response_cache);
+      c.argh->setAbbreviations(abbreviations);
+      c.argh->parallel = parallel;
+      c.factory(*c.argh);
+    }
+    return *c.argh;
+  }
+
+  enum { Absent, Named, HasValue };
+
+  // Records the last raw text for each option, for reload() to compare
+  struct RawSink {
+    std::vector<std::string_view>& values;
+    std::vector<char>& state;
+
+    void setValue(Option& o, std::string_view val) {
+      values[o.getId()] = val;
+      state[o.getId()] = HasValue;
+    }
+
+    void setParsed(Option& o) { state[o.getId()] = std::max<char>(state[o.getId()], Named); }
+  };
+
+  struct Staged {
+    std::string value;
+    int priority;
+    bool has_value, parsed;
+  };
+
+  // A matched option takes the token that follows it as its value, whether or not that token is a name too
+  Option* match(std::string_view token) const {
+    auto o = index.find(token);
+    if (!o && abbreviations && token.size() > 2 && token.compare(0, 2, "--") == 0) {
+      o = prefix_index.find(token);
+    }
+    return o;
+  }
+
+  template<typename Sink>
+  void parseToken(Option*& pending, std::string_view token, Sink&& sink) const {
+    if (pending) {
+      sink.setValue(*pending, token);
+      pending = nullptr;
+    }
+    auto o = match(token);
+    if (o) {
+      sink.setParsed(*o);
+      pending = o;
+    }
+  }
+
+  static constexpr int max_response_depth = 16;
+
+  bool isResponseFile(std::string_view token) const { return response_files && token.size() > 1 && token[0] == '@'; }
+
+  template<typename Sink>
+  void parseArg(Option*& pending, std::string_view token, Sink&& sink, int depth) const {
+    if (depth < max_response_depth && isResponseFile(token)) {
+      auto file = ResponseFile::open(std::string(token.substr(1)), response_cache);
+      if (file->good()) {
+        sink.keep(file);
+        for (auto t : file->getTokens()) {
+          parseArg(pending, t, sink, depth + 1);
+        }
+        return;
+      }
+    }
+    parseToken(pending, token, sink);
+  }
+
+  void parseEnv(NameIndex const& names, std::string_view prefix) {
+    for (auto env = environment(); env && *env; ++env) {
+      std::string_view entry(*env);
+      count(&ArghStats::bytes_tokenized, entry.size());
+      size_t eq = entry.find('=');
+      if (eq == std::string_view::npos || entry.compare(0, prefix.size(), prefix) != 0) { continue; }
+      auto o = names.find(entry.substr(prefix.size(), eq - prefix.size()));
+      if (o) {
+        BoundSink sink{ *this };
+        sink.setParsed(*o);
+        sink.setValue(*o, entry.substr(eq + 1));
+      }
+    }
+  }
+
+  static constexpr std::string_view snapshot_magic = "ARGHSNAP";
+  static constexpr std::string_view schema_magic = "ARGHSCHM";
+
+  uint64_t schemaHash() const {
+    uint64_t h = NameIndex::hash("");
+    for (auto o : options) {
+      h = NameIndex::hash(o->getName(), h);
+      h = NameIndex::hash(std::string_view("", 1), h);
+      h = NameIndex::hash(o->getType().name(), h);
+      h = NameIndex::hash(std::string_view("", 1), h);
+    }
+    return h;
+  }
+
+  std::string_view envName(std::string_view name) {
+    name.remove_prefix(std::min(name.find_first_not_of('-'), name.size()));
+    auto p = static_cast<char*>(arena.allocate(name.size(), 1));
+    for (size_t i = 0; i < name.size(); ++i) {
+      p[i] = name[i] == '-' ? '_' : static_cast<char>(std::toupper(static_cast<unsigned char>(name[i])));
+    }
+    return std::string_view(p, name.size());
+  }
+
+  Usage usage() {
+    Usage usage;
+    for (auto o : options) {
+      usage.add(o->getName(), o->getDefault(), o->getMessage(), o->getRequired());
+    }
+    return usage;
+  }
+
+  template<typename O, typename... Args>
+  size_t add(Args&&... args) {
+    auto o = new (arena.allocate(sizeof(O), alignof(O))) O(std::forward<Args>(args)...);
+    o->id = options.size();
+    o->parsed_bits = &parsed_bits;
+    options.push_back(o);
+    parsed_bits.resize(options.size());
+    required_bits.resize(options.size());
+    required_bits.set(o->id, o->getRequired());
+    if (staging) { staged.resize(options.size()); }
+    index.insert(o->getName(), o);
+    if (abbreviations) { prefixes(); }
+    return o->id;
+  }
+
+  // Sorted lazily, the first time it is wanted, then kept up to date
+  PrefixIndex const& prefixes() {
+    prefix_index.add(options, prefix_index_size);
+    prefix_index_size = options.size();
+    return prefix_index;
+  }
+
+  // Names short enough are null terminated on the stack rather than copied into a std::string
+  template<typename F>
+  static bool withFilename(std::string_view filename, F f) {
+    char buffer[256];
+    if (filename.size() >= sizeof(buffer)) { return f(std::string(filename).c_str()); }
+    std::memcpy(buffer, filename.data(), filename.size());
+    buffer[filename.size()] = '\0';
+    return f(static_cast<char const*>(buffer));
+  }
+
+  // Copies into the arena, so names and messages outlive whatever they were registered from
+  std::string_view intern(std::string_view str) {
+    auto p = static_cast<char*>(arena.allocate(str.size(), 1));
+    std::memcpy(p, str.data(), str.size());
+    return std::string_view(p, str.size());
+  }
+
+#if defined(ARGH_STATS)
+  ArghStats stats;
+  std::function<void(ArghStats::Phase, ArghStats const&)> stats_callback;
+  uint64_t (*allocation_counter)() = nullptr;
+  int depth = 0;
+  CountingResource counting;
+#endif
+  std::pmr::monotonic_buffer_resource arena;
+  std::vector<Option*> options;
+  Bitset parsed_bits;
+  Bitset required_bits;
+  NameIndex index;
+  NameIndex env_index;
+  size_t env_index_size;
+  PrefixIndex prefix_index;
+  size_t prefix_index_size;
+  std::string schema_json;
+  size_t schema_json_size;
+  std::string schema_binary;
+  size_t schema_binary_size;
+  bool abbreviations;
+  bool response_files;
+  bool response_cache;
+  // A deque, so the index can point at commands while more are added
+  std::deque<Command> commands;
+  BasicNameIndex<Command> command_index;
+  Command* selected;
+  char delim;
+  ParallelLists parallel;
+  std::vector<Staged> staged;
+  std::vector<std::string> reloaded;
+  std::vector<char> reloaded_state;
+  bool staging;
+  int priority;
+};
+
+// Per-parse state for a shared Argh. A fresh result holds every option's default.
+class ArghResult {
+  friend class Argh;
+
+public:
+  ArghResult(Argh const& argh) : argh(&argh) { grow(); }
+
+  bool isParsed(std::string_view name) const {
+    auto o = argh->index.find(name);
+    return o && o->getId() < parsed.size() && parsed[o->getId()];
+  }
+
+  // Reuses the storage already held by the values, so a result can be recycled without allocating
+  void reset() {
+    grow();
+    for (auto o : argh->options) {
+      o->resetValue(values[o->getId()]);
+    }
+    std::fill(parsed.begin(), parsed.end(), false);
+    files.clear();
+  }
+
+  template<typename T>
+  bool isParsed(OptionHandle<T> handle) const { return parsed[handle.id]; }
+
+  template<typename T>
+  T const& get(OptionHandle<T> handle) const { return *std::any_cast<T>(&values[handle.id]); }
+
+  // Null when there is no such option or T isn't its type
+  template<typename T>
+  T const* get(std::string_view name) const {
+    auto o = argh->index.find(name);
+    return o && o->getId() < values.size() ? std::any_cast<T>(&values[o->getId()]) : nullptr;
+  }
+
+protected:
+  // Picks up the defaults of options added to the Argh since the result was last parsed into
+  void grow() {
+    for (size_t i = values.size(); i < argh->options.size(); ++i) {
+      values.push_back(argh->options[i]->makeValue());
+    }
+    parsed.resize(values.size(), false);
+  }
+
+  void setValue(Option& o, std::string_view val) { o.setValue(values[o.getId()], val); }
+  void setParsed(Option& o) { parsed[o.getId()] = true; o.markParsed(values[o.getId()]); }
+  void keep(std::shared_ptr<ResponseFile const> const& file) { files.push_back(file); }
+
+  Argh const* argh;
+  std::vector<std::any> values;
+  std::vector<bool> parsed;
+  // Response files read by the parse, since string_view values point into their tokens
+  std::vector<std::shared_ptr<ResponseFile const>> files;
+};
+
+inline void Argh::parse(ArghResult& result, int argc, char const* argv[]) const {
+  result.grow();
+  Option* pending = nullptr;
+  for (int i = 0; i < argc; ++i) {
+    parseArg(pending, argv[i], result, 0);
+  }
+}
+
+// Columnar results of a batch parse: for each option, a std::vector holding its value on every command line,
+// and a bitmap of the lines it appeared on
+class ArghBatch {
+  friend class Argh;
+
+public:
+  ArghBatch(Argh const& argh) : argh(&argh), rows(0) {}
+
+  // Command lines in the last batch
+  size_t size() const { return rows; }
+
+  bool isParsed(std::string_view name, size_t row) const {
+    auto p = getParsed(name);
+    return p && (*p)[row];
+  }
+
+  // Null when there is no such option or T isn't its type. Multi-options give std::vector<std::vector<T>>.
+  template<typename T>
+  std::vector<T> const* column(std::string_view name) const {
+    auto o = argh->index.find(name);
+    return o && o->getId() < columns.size() ? std::any_cast<std::vector<T>>(&columns[o->getId()]) : nullptr;
+  }
+
+  std::vector<bool> const* getParsed(std::string_view name) const {
+    auto o = argh->index.find(name);
+    return o && o->getId() < parsed.size() ? &parsed[o->getId()] : nullptr;
+  }
+
+protected:
+  // Collects values per option; nothing is converted until every line has been matched
+  struct Sink {
+    ArghBatch& batch;
+    size_t row;
+
+    void setValue(Option& o, std::string_view val) { batch.cells[o.getId()].push_back(BatchCell{ row, val }); }
+    void setParsed(Option& o) { batch.parsed[o.getId()][row] = true; }
+  };
+
+  // Keeps the capacity of the cell lists from the last batch
+  void start(size_t rows) {
+    this->rows = rows;
+    size_t n = argh->options.size();
+    columns.resize(n);
+    parsed.resize(n);
+    cells.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      parsed[i].assign(rows, false);
+      cells[i].clear();
+    }
+  }
+
+  Argh const* argh;
+  size_t rows;
+  std::vector<std::any> columns;
+  std::vector<std::vector<bool>> parsed;
+  std::vector<std::vector<BatchCell>> cells;
+};
+
+inline void Argh::parse(ArghBatch& batch, std::vector<std::string_view> const& tokens, std::vector<size_t> const& offsets) const {
+  size_t rows = offsets.empty() ? 0 : offsets.size() - 1;
+  batch.start(rows);
+  for (size_t row = 0; row < rows; ++row) {
+    Option* pending = nullptr;
+    for (size_t i = offsets[row]; i < offsets[row + 1]; ++i) {
+      parseToken(pending, tokens[i], ArghBatch::Sink{ batch, row });
+    }
+  }
+  for (auto o : options) {
+    o->resetColumn(batch.columns[o->getId()], rows);
+    o->fillColumn(batch.columns[o->getId()], batch.parsed[o->getId()], batch.cells[o->getId()]);
+  }
+}
+
+// Calls reload() from a background thread whenever the file changes. The file is reloaded once up front, on the
+// calling thread. Later changes write the bound variables and run the callback on the watcher's thread, so
+// anything read elsewhere needs its own synchronisation. On Linux the file is reloaded when inotify reports it
+// closed after writing or moved into place, so a half-written file is never applied. Elsewhere the modification
+// time and size are polled, and a change is only acted on once they have held still for a whole interval.
+class ArghWatcher {
+public:
+  ArghWatcher(Argh& argh, std::string_view filename, std::function<void(std::string_view)> changed = nullptr,
+    std::chrono::milliseconds interval = std::chrono::milliseconds(500)) :
+    argh(argh),
+    filename(filename),
+    changed(std::move(changed)),
+    interval(interval),
+    stamp(fileStamp(this->filename.c_str())),
+    seen(stamp),
+    stopping(false)
+  {
+    argh.reload(this->filename, this->changed);
+#if defined(__linux__)
+    notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notify >= 0) {
+      // Watch the directory: editors tend to replace the file rather than write to it
+      auto slash = this->filename.find_last_of('/');
+      std::string dir = slash == std::string::npos ? "." : this->filename.substr(0, slash + 1);
+      base = slash == std::string::npos ? this->filename : this->filename.substr(slash + 1);
+      if (inotify_add_watch(notify, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        close(notify);
+        notify = -1;
+      }
+    }
+    if (pipe(wake) != 0) { wake[0] = wake[1] = -1; }
+#endif
+    thread = std::thread([this] { run(); });
+  }
+
+  ~ArghWatcher() { stop(); }
+
+  ArghWatcher(ArghWatcher const&) = delete;
+  ArghWatcher& operator=(ArghWatcher const&) = delete;
+
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (stopping) { return; }
+      stopping = true;
+    }
+    wakeup.notify_all();
+#if defined(__linux__)
+    if (wake[1] >= 0) { (void)!write(wake[1], "", 1); }
+#endif
+    thread.join();
+#if defined(__linux__)
+    if (notify >= 0) { close(notify); }
+    if (wake[0] >= 0) { close(wake[0]); close(wake[1]); }
+#endif
+  }
+
+protected:
+  void run() {
+    bool written = false;
+    while (wait(written)) {
+      auto now = fileStamp(filename.c_str());
+      // Polling can't tell when a writer is done, so the stamp has to match the one seen last time round
+      bool settled = watching() ? written : now == seen;
+      seen = now;
+      if (now != stamp && settled) {
+        stamp = now;
+        argh.reload(filename, changed);
+      }
+    }
+  }
+
+  bool watching() const {
+#if defined(__linux__)
+    return notify >= 0 && wake[0] >= 0;
+#else
+    return false;
+#endif
+  }
+
+  // False once stopped. Otherwise returns when the interval is up, or sooner with written set when inotify
+  // reports the file finished.
+  bool wait(bool& written) {
+    written = false;
+#if defined(__linux__)
+    if (watching()) {
+      pollfd fds[2] = { { notify, POLLIN, 0 }, { wake[0], POLLIN, 0 } };
+      poll(fds, 2, static_cast<int>(interval.count()));
+      alignas(inotify_event) char events[4096];
+      for (ssize_t n; (n = read(notify, events, sizeof(events))) > 0;) {
+        for (char* p = events; p < events + n;) {
+          auto event = reinterpret_cast<inotify_event*>(p);
+          if (event->len && base == event->name) { written = true; }
+          p += sizeof(inotify_event) + event->len;
+        }
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      return !stopping;
+    }
+#endif
+    std::unique_lock<std::mutex> lock(mutex);
+    return !wakeup.wait_for(lock, interval, [this] { return stopping; });
+  }
+
+  Argh& argh;
+  std::string filename;
+  std::function<void(std::string_view)> changed;
+  std::chrono::milliseconds interval;
+  std::pair<int64_t, uint64_t> stamp, seen;
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  bool stopping;
+#if defined(__linux__)
+  std::string base;
+  int notify;
+  int wake[2];
+#endif
+  std::thread thread;
+};
+
+// Text a static option keeps a view of rather than copying, so it has to outlive the option: a literal, or
+// anything else in static storage. Temporary strings are rejected at compile time.
+struct StaticText : std::string_view {
+  constexpr StaticText(char const* text) : std::string_view(text) {}
+  constexpr StaticText(std::string_view text) : std::string_view(text) {}
+  StaticText(std::string const& text) : std::string_view(text) {}
+  StaticText(std::string&&) = delete;
+};
+
+// Compile-time counterparts of the options above for StaticArgh: no vtable, and names, messages and default
+// lists are views, not copies. The only allocation is a default rendered for the usage text.
+class StaticOptionBase {
+public:
+  StaticOptionBase(StaticText name, bool required, StaticText msg) :
+    name(name),
+    msg(msg),
+    hash(NameIndex::hash(name)),
+    parsed(false),
+    required(required),
+    default_cached(false)
+  {}
+
+  bool matches(uint64_t h, std::string_view token) const { return hash == h && name == token; }
+
+  std::string_view getName() const    { return name;     }
+  std::string_view getMessage() const { return msg;      }
+  bool             getParsed() const  { return parsed;   }
+  bool             getRequired() const { return required; }
+  void             setParsed(bool parsed) { this->parsed = parsed; }
+
+protected:
+  template<typename F>
+  std::string_view cachedDefault(F render) const {
+    if (!default_cached) {
+      default_str = render();
+      default_cached = true;
+    }
+    return default_str;
+  }
+
+  std::string_view name, msg;
+  uint64_t hash;
+  bool parsed, required;
+  mutable std::string default_str;
+  mutable bool default_cached;
+};
+
+template<typename T>
+class StaticOption : public StaticOptionBase {
+public:
+  StaticOption(T& var, T const& default_val, StaticText name, bool required = false, StaticText msg = "") :
+    StaticOptionBase(name, required, msg),
+    default_val(default_val),
+    var(&var)
+  {
+    var = default_val;
+  }
+
+  std::string_view getDefault() const { return cachedDefault([this] { return formatDefault(default_val); }); }
+  void setValue(std::string_view val) { Converter<T>::convert(val, *var); }
+
+protected:
+  T default_val;
+  T* var;
+};
+
+template<typename T>
+class StaticMultiOption : public StaticOptionBase {
+public:
+  StaticMultiOption(std::vector<T>& var, StaticText default_vals, StaticText name, bool required = false, StaticText msg = "", char delim = ',') :
+    StaticOptionBase(name, required, msg),
+    default_vals(default_vals),
+    var(&var),
+    delim(delim)
+  {
+    setValue(default_vals);
+  }
+
+  std::string_view getDefault() const { return cachedDefault([this] { return formatDefault(std::string(default_vals)); }); }
+  void setValue(std::string_view val) { assignList(*var, val, delim); }
+
+protected:
+  std::string_view default_vals;
+  std::vector<T>* var;
+  char delim;
+};
+
+class StaticFlag : public StaticOptionBase {
+public:
+  StaticFlag(bool& flag, StaticText name, StaticText msg = "") :
+    StaticOptionBase(name, false, msg),
+    flag(&flag)
+  {
+    flag = false;
+  }
+
+  std::string_view getDefault() const { return ""; }
+  void setParsed(bool parsed) { StaticOptionBase::setParsed(parsed); *flag = parsed; }
+  void setValue(std::string_view) {}
+
+protected:
+  bool* flag;
+};
+
+// Front end for option sets fixed at compile time. Matching is an unrolled hash-and-compare over the pack.
+//   StaticArgh argh(StaticFlag(help, "--help"), StaticOption<int>(mynumber, 123, "--mynumber"));
+template<typename... Options>
+class StaticArgh {
+public:
+  StaticArgh(Options... options) : options(options...) {}
+
+  void parse(int argc, char const* argv[]) {
+    size_t pending = npos;
+    for (int i = 0; i < argc; ++i) {
+      parseToken(pending, argv[i]);
+    }
+  }
+
+  bool isParsed(std::string_view name) const {
+    bool parsed = false;
+    visit(find(name), [&parsed](auto const& o) { parsed = o.getParsed(); });
+    return parsed;
+  }
+
+  std::vector<std::string> missingRequired() const {
+    std::vector<std::string> missing;
+    auto check = [&missing](auto const& o) {
+      if (o.getRequired() && !o.getParsed()) { missing.emplace_back(o.getName()); }
+    };
+    std::apply([&check](auto const&... o) { (check(o), ...); }, options);
+    return missing;
+  }
+
+  std::string getUsage() const { return usage().str(); }
+  void printUsage(std::ostream& os) const { usage().print(os); }
+
+protected:
+  Usage usage() const {
+    Usage usage;
+    std::apply([&usage](auto const&... o) {
+      (usage.add(o.getName(), o.getDefault(), o.getMessage(), o.getRequired()), ...);
+    }, options);
+    return usage;
+  }
+
+  static constexpr size_t npos = sizeof...(Options);
+
+  void parseToken(size_t& pending, std::string_view token) {
+    visit(pending, [token](auto& o) { o.setValue(token); });
+    pending = find(token);
+    visit(pending, [](auto& o) { o.setParsed(true); });
+  }
+
+  size_t find(std::string_view token) const {
+    return find(NameIndex::hash(token), token, std::index_sequence_for<Options...>());
+  }
+
+  template<size_t... Is>
+  size_t find(uint64_t h, std::string_view token, std::index_sequence<Is...>) const {
+    size_t found = npos;
+    ((std::get<Is>(options).matches(h, token) ? (found = Is, true) : false) || ...);
+    return found;
+  }
+
+  template<typename F>
+  void visit(size_t i, F f) { visit(i, f, std::index_sequence_for<Options...>()); }
+
+  template<typename F>
+  void visit(size_t i, F f) const { visit(i, f, std::index_sequence_for<Options...>()); }
+
+  template<typename F, size_t... Is>
+  void visit(size_t i, F& f, std::index_sequence<Is...>) { ((i == Is ? f(std::get<Is>(options)) : void()), ...); }
+
+  template<typename F, size_t... Is>
+  void visit(size_t i, F& f, std::index_sequence<Is...>) const { ((i == Is ? f(std::get<Is>(options)) : void()), ...); }
+
+  std::tuple<Options...> options;
+};
+
+#if defined(ARGH_STATS)
+}
+#endif
@@ -0,0 +1,270 @@
+// Self-contained benchmarks for argh.h
+//   g++ -O2 -std=c++17 -o bench bench.cpp -pthread
+// Prints time and heap allocations per operation for parse, batch parse, load, multi-option splitting, parseEnv and getUsage
+//   ./bench --check baseline.txt
+// Instead measures tokenizing throughput in MB/s and fails if any figure falls below the one in the baseline file
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../argh.h"
+
+static std::atomic<size_t> allocations(0);
+
+void* operator new(size_t size) {
+  ++allocations;
+  if (void* p = std::malloc(size ? size : 1)) { return p; }
+  throw std::bad_alloc();
+}
+
+// Once GCC inlines these it sees free() on memory from operator new and warns at every delete expression
+#if defined(__GNUC__)
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+BENCH_NOINLINE void operator delete(void* p) noexcept { std::free(p); }
+BENCH_NOINLINE void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// Repeats f until it has run for at least a fifth of a second, returning the time per call
+template<typename F>
+double run(std::string const& name, size_t param, F f) {
+  using clock = std::chrono::steady_clock;
+  f();
+  size_t iterations = 0;
+  size_t allocated = allocations;
+  auto start = clock::now();
+  auto elapsed = clock::duration::zero();
+  do {
+    f();
+    ++iterations;
+    elapsed = clock::now() - start;
+  } while (elapsed < std::chrono::milliseconds(200));
+  allocated = allocations - allocated;
+
+  double ns = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+  std::printf("%-24s %10zu %14.0f ns/op %12.1f allocs/op\n", name.c_str(), param, ns, double(allocated) / iterations);
+  return ns;
+}
+
+std::string optionName(size_t i) { return "--option" + std::to_string(i); }
+
+struct Fixture {
+  Fixture(size_t count) : values(count) {
+    for (size_t i = 0; i < count; ++i) {
+      argh.addOption<int>(values[i], static_cast<int>(i), optionName(i), false, "Option number " + std::to_string(i));
+    }
+  }
+
+  Argh argh;
+  std::vector<int> values;
+};
+
+void benchParse() {
+  for (size_t count : { 10, 100, 1000 }) {
+    for (size_t argc : { 10, 100, 1000 }) {
+      Fixture fixture(count);
+      std::vector<std::string> tokens;
+      for (size_t i = 0; i < argc; i += 2) {
+        tokens.push_back(optionName(i % count));
+        tokens.push_back(std::to_string(i));
+      }
+      std::vector<char const*> argv;
+      for (auto const& t : tokens) { argv.push_back(t.c_str()); }
+      run("parse/" + std::to_string(count) + "options", argc, [&] {
+        fixture.argh.parse(static_cast<int>(argv.size()), argv.data());
+      });
+    }
+  }
+}
+
+// The same jobs one ArghResult parse at a time, then as one batch
+void benchBatch() {
+  Fixture fixture(100);
+  for (size_t jobs : { 100, 10000 }) {
+    std::vector<std::string> text;
+    for (size_t j = 0; j < jobs; ++j) {
+      for (size_t i = 0; i < 10; ++i) {
+        text.push_back(optionName((j + i * 7) % 100));
+        text.push_back(std::to_string(j));
+      }
+    }
+    std::vector<char const*> argv;
+    std::vector<std::string_view> tokens;
+    std::vector<size_t> offsets;
+    for (size_t t = 0; t < text.size(); ++t) {
+      if (t % 20 == 0) { offsets.push_back(t); }
+      argv.push_back(text[t].c_str());
+      tokens.push_back(text[t]);
+    }
+    offsets.push_back(text.size());
+    ArghResult result(fixture.argh);
+    run("parse/jobs", jobs, [&] {
+      for (size_t j = 0; j < jobs; ++j) {
+        result.reset();
+        fixture.argh.parse(result, 20, argv.data() + j * 20);
+      }
+    });
+    ArghBatch batch(fixture.argh);
+    run("parse/batch", jobs, [&] { fixture.argh.parse(batch, tokens, offsets); });
+  }
+}
+
+// Scaled up argh.opts: every option once, then a long list for the multi-option
+void benchLoad() {
+  for (size_t lines : { 100, 10000, 1000000 }) {
+    Fixture fixture(100);
+    std::vector<int> multi;
+    fixture.argh.addMultiOption<int>(multi, "", "--multivalue");
+    {
+      std::ofstream ofs("bench.opts");
+      for (size_t i = 0; i < lines; i += 2) {
+        ofs << optionName(i % 100) << "\n" << i << "\n";
+      }
+      ofs << "--multivalue\n";
+      for (size_t i = 0; i < lines; ++i) {
+        ofs << i << (i + 1 < lines ? "," : "\n");
+      }
+    }
+    run("load", lines, [&] { fixture.argh.load("bench.opts"); });
+    std::remove("bench.opts");
+  }
+}
+
+template<typename T>
+void benchMulti(std::string const& type, ParallelLists const* parallel = nullptr) {
+  for (size_t length : { 100, 10000, 1000000 }) {
+    std::string list;
+    for (size_t i = 0; i < length; ++i) {
+      list += std::to_string(i * 7) + (i + 1 < length ? "," : "");
+    }
+    std::vector<T> var;
+    MultiOptionImpl<T> option(var, "", "--multi", false, "", ',', parallel);
+    run("multi/" + type, length, [&] { option.setValue(list); });
+  }
+}
+
+void setEnv(std::string const& name, std::string const& value) {
+#if defined(_WIN32)
+  _putenv_s(name.c_str(), value.c_str());
+#else
+  setenv(name.c_str(), value.c_str(), 1);
+#endif
+}
+
+void benchParseEnv() {
+  Fixture fixture(100);
+  for (size_t i = 0; i < 10; ++i) {
+    setEnv(optionName(i), std::to_string(i));
+  }
+  size_t filled = 0;
+  for (size_t size : { 10, 100, 1000 }) {
+    for (; filled < size; ++filled) {
+      setEnv("ARGH_BENCH_" + std::to_string(filled), "value");
+    }
+    run("parseEnv/100options", size, [&] { fixture.argh.parseEnv(); });
+    run("parseEnv/prefixed", size, [&] { fixture.argh.parseEnv("ARGH_BENCH_"); });
+  }
+}
+
+void benchUsage() {
+  for (size_t count : { 10, 100, 1000 }) {
+    Fixture fixture(count);
+    run("getUsage", count, [&] { fixture.argh.getUsage(); });
+  }
+}
+
+// An argh.opts style file: every option once, then a long list for the multi-option
+std::string generateOpts(size_t lines) {
+  std::ostringstream os;
+  for (size_t i = 0; i < lines; i += 2) {
+    os << optionName(i % 100) << "\n" << i << "\n";
+  }
+  os << "--multivalue\n";
+  for (size_t i = 0; i < lines; ++i) {
+    os << i * 7 << (i + 1 < lines ? "," : "\n");
+  }
+  return os.str();
+}
+
+// Baseline lines are "<name> <MB/s>"; set them for the slowest machine the check runs on
+int checkThroughput(char const* baseline_file) {
+  std::map<std::string, double> baseline;
+  std::ifstream ifs(baseline_file);
+  for (std::string name; ifs >> name;) {
+    ifs >> baseline[name];
+  }
+  if (baseline.empty()) {
+    std::printf("no baseline in %s\n", baseline_file);
+    return EXIT_FAILURE;
+  }
+
+  Fixture fixture(100);
+  std::vector<int> multi;
+  fixture.argh.addMultiOption<int>(multi, "", "--multivalue");
+  std::string text = generateOpts(1000000);
+  {
+    std::ofstream ofs("bench.opts", std::ios::binary);
+    ofs << text;
+  }
+  std::map<std::string, double> measured;
+  double mb = text.size() / 1e6;
+  measured["load/mapped"] = mb / (run("load/mapped", text.size(), [&] { fixture.argh.load("bench.opts"); }) / 1e9);
+  measured["load/chunked"] = mb / (run("load/chunked", text.size(), [&] {
+    Argh::Loader loader(fixture.argh);
+    for (size_t at = 0; at < text.size(); at += 4096) {
+      loader.write(std::string_view(text).substr(at, 4096));
+    }
+    loader.finish();
+  }) / 1e9);
+  std::remove("bench.opts");
+
+  std::string list = text.substr(text.rfind("--multivalue\n") + 13);
+  std::vector<double> doubles;
+  std::vector<std::string> strings;
+  double list_mb = list.size() / 1e6;
+  measured["split/count"] = list_mb / (run("split/count", list.size(), [&] { countDelims(list, ','); }) / 1e9);
+  measured["split/double"] = list_mb / (run("split/double", list.size(), [&] { assignList(doubles, list, ','); }) / 1e9);
+  measured["split/string"] = list_mb / (run("split/string", list.size(), [&] { assignList(strings, list, ','); }) / 1e9);
+
+  int status = EXIT_SUCCESS;
+  for (auto const& b : baseline) {
+    auto m = measured.find(b.first);
+    if (m == measured.end()) {
+      std::printf("%-24s unknown\n", b.first.c_str());
+      status = EXIT_FAILURE;
+      continue;
+    }
+    bool ok = m->second >= b.second;
+    std::printf("%-24s %10.1f MB/s (baseline %.1f) %s\n", b.first.c_str(), m->second, b.second, ok ? "ok" : "TOO SLOW");
+    if (!ok) { status = EXIT_FAILURE; }
+  }
+  return status;
+}
+
+int main(int argc, char const* argv[]) {
+  if (argc == 3 && std::strcmp(argv[1], "--check") == 0) {
+    return checkThroughput(argv[2]);
+  }
+  benchParse();
+  benchBatch();
+  benchLoad();
+  benchMulti<int>("int");
+  benchMulti<double>("double");
+  ParallelLists parallel{ 1 << 16, std::thread::hardware_concurrency() };
+  benchMulti<double>("double/parallel", &parallel);
+  benchMulti<std::string>("string");
+  benchParseEnv();
+  benchUsage();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,209 @@
+// Fuzz target for the tokenizer and converters in argh.h
+//   clang++ -g -O1 -std=c++17 -fsanitize=fuzzer,address,undefined -o fuzz fuzz.cpp
+// AFL++ takes the same source through afl-clang-fast++ -fsanitize=fuzzer. Without libFuzzer, define
+// ARGH_FUZZ_MAIN to get a main that replays the files named on the command line:
+//   g++ -g -O1 -std=c++17 -fsanitize=address,undefined -DARGH_FUZZ_MAIN -o fuzz fuzz.cpp -pthread
+//
+// The first input byte chooses the delimiter, the rest is option text. Besides looking for crashes, every
+// input is pushed down paths that have to agree with each other, and the program aborts when they don't:
+// the SIMD splitter against a plain one, the parallel list conversion against the serial one, parsing into
+// bound variables against parsing into an ArghResult, and the chunked Loader and the mapped file against one
+// big load from a stream.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../argh.h"
+
+namespace {
+
+void check(bool ok) {
+  if (!ok) { std::abort(); }
+}
+
+// NaN is a fine parse result, and has to compare equal to itself here
+bool same(double a, double b) { return (std::isnan(a) && std::isnan(b)) || a == b; }
+
+bool same(std::vector<double> const& a, std::vector<double> const& b) {
+  if (a.size() != b.size()) { return false; }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (!same(a[i], b[i])) { return false; }
+  }
+  return true;
+}
+
+// What split() has to produce: std::getline fields, no empty one after a trailing delimiter
+std::vector<std::string> referenceSplit(std::string const& text, char delim) {
+  std::vector<std::string> fields;
+  std::istringstream ss(text);
+  for (std::string field; std::getline(ss, field, delim);) {
+    fields.push_back(field);
+  }
+  return fields;
+}
+
+// What an int field has to convert to, from the C library rather than from argh: strtol clamped to int, which
+// is what stream extraction does with values out of range
+int referenceInt(std::string const& field) {
+  long val = std::strtol(field.c_str(), nullptr, 10);
+  return static_cast<int>(std::clamp<long>(val, std::numeric_limits<int>::lowest(), std::numeric_limits<int>::max()));
+}
+
+void fuzzLists(std::string const& text, char delim) {
+  auto reference = referenceSplit(text, delim);
+
+  std::vector<std::string> strings;
+  assignList(strings, text, delim);
+  check(strings == reference);
+  check(countDelims(text, delim) == static_cast<size_t>(std::count(text.begin(), text.end(), delim)));
+
+  std::vector<int> ints, parallel_ints;
+  assignList(ints, text, delim);
+  check(ints.size() == reference.size());
+  for (size_t i = 0; i < ints.size(); ++i) {
+    check(ints[i] == referenceInt(reference[i]));
+  }
+  assignListParallel(parallel_ints, text, delim, 3);
+  check(parallel_ints == ints);
+
+  std::vector<double> doubles, parallel_doubles;
+  assignList(doubles, text, delim);
+  assignListParallel(parallel_doubles, text, delim, 5);
+  check(same(doubles, parallel_doubles));
+
+  // Through the option itself, twice, so the in-place reuse of string elements is covered
+  std::vector<std::string> var;
+  MultiOptionStringImpl option(var, "", "--multi", false, "", delim);
+  option.setValue(text);
+  option.setValue(text.substr(text.size() / 2));
+  check(var == referenceSplit(text.substr(text.size() / 2), delim));
+}
+
+struct Values {
+  int i = 0;
+  double d = 0;
+  bool b = false, flag = false;
+  std::string s;
+  std::vector<int> ints;
+  std::vector<double> doubles;
+  std::vector<std::string> strings;
+  std::vector<std::string_view> views;
+};
+
+void addOptions(Argh& argh, Values& v) {
+  argh.addOption<int>(v.i, 1, "--intvalue");
+  argh.addOption<double>(v.d, 2.5, "--doublevalue");
+  argh.addOption<bool>(v.b, false, "--boolvalue");
+  argh.addOption<std::string>(v.s, "Default", "--stringvalue");
+  argh.addMultiOption<int>(v.ints, "1,2", "--multivalue");
+  argh.addMultiOption<double>(v.doubles, "", "--multidouble");
+  argh.addMultiOption<std::string>(v.strings, "a,b", "--multistring");
+  argh.addMultiOption<std::string_view>(v.views, "", "--multiview");
+  argh.addFlag(v.flag, "--flag");
+}
+
+// One file per process, so parallel fuzzing jobs don't write over each other's input
+std::string const& tempPath() {
+  static std::string const path =
+    (std::filesystem::temp_directory_path() / ("argh-fuzz-" + std::to_string(std::random_device()()) + ".opts")).string();
+  return path;
+}
+
+bool same(Values const& a, Values const& b) {
+  return a.i == b.i && same(a.d, b.d) && a.b == b.b && a.flag == b.flag && a.s == b.s && a.ints == b.ints
+    && same(a.doubles, b.doubles) && a.strings == b.strings && a.views == b.views;
+}
+
+void fuzzParse(std::string const& text, char delim) {
+  std::vector<std::string> tokens;
+  forEachLine(text, [&tokens](std::string_view line) { tokens.emplace_back(line); });
+  std::vector<char const*> argv;
+  for (auto const& t : tokens) { argv.push_back(t.c_str()); }
+
+  Values bound;
+  Argh argh(delim);
+  addOptions(argh, bound);
+  argh.setAbbreviations(text.size() % 2 == 1);
+  argh.parse(static_cast<int>(argv.size()), argv.data());
+
+  ArghResult result(argh);
+  argh.parse(result, static_cast<int>(argv.size()), argv.data());
+  check(*result.get<int>("--intvalue") == bound.i);
+  check(same(*result.get<double>("--doublevalue"), bound.d));
+  check(*result.get<bool>("--flag") == bound.flag);
+  check(*result.get<std::string>("--stringvalue") == bound.s);
+  check(*result.get<std::vector<int>>("--multivalue") == bound.ints);
+  check(*result.get<std::vector<std::string>>("--multistring") == bound.strings);
+  check(result.isParsed("--multiview") == argh.isParsed("--multiview"));
+
+  // Tokens with embedded nulls are cut short by argv, so the loader is compared against its own kind
+  Values streamed, chunked;
+  Argh whole(delim), pieces(delim);
+  addOptions(whole, streamed);
+  addOptions(pieces, chunked);
+  std::istringstream is(text);
+  whole.load(is);
+  Argh::Loader loader(pieces);
+  for (size_t at = 0, step = 1; at < text.size(); at += step, step = step * 3 % 17 + 1) {
+    loader.write(std::string_view(text).substr(at, step));
+  }
+  loader.finish();
+  check(same(streamed, chunked));
+  check(whole.missingRequired() == pieces.missingRequired());
+
+  Values mapped;
+  Argh file(delim);
+  addOptions(file, mapped);
+  {
+    std::ofstream ofs(tempPath(), std::ios::binary | std::ios::trunc);
+    ofs.write(text.data(), static_cast<std::streamsize>(text.size()));
+  }
+  file.load(tempPath());
+  check(same(streamed, mapped));
+  check(whole.missingRequired() == file.missingRequired());
+  std::remove(tempPath().c_str());
+
+  // Only for crashes: the suggestion search walks the sorted names from arbitrary points
+  whole.suggest(std::string_view(text).substr(0, 32));
+  whole.completions(std::string_view(text).substr(0, 4));
+}
+
+void fuzzOne(uint8_t const* data, size_t size) {
+  if (size == 0) { return; }
+  static char const delims[] = { ',', '|', ' ', '\n', '\0', '-', '1', 'a' };
+  char delim = delims[data[0] % sizeof(delims)];
+  std::string text(reinterpret_cast<char const*>(data) + 1, size - 1);
+  fuzzLists(text, delim);
+  fuzzParse(text, delim);
+}
+
+}
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const* data, size_t size) {
+  fuzzOne(data, size);
+  return 0;
+}
+
+#if defined(ARGH_FUZZ_MAIN)
+#include <fstream>
+#include <iterator>
+
+int main(int argc, char const* argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    std::ifstream ifs(argv[i], std::ios::binary);
+    std::string input((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    LLVMFuzzerTestOneInput(reinterpret_cast<uint8_t const*>(input.data()), input.size());
+  }
+  return EXIT_SUCCESS;
+}
+#endif
@@ -0,0 +1,49 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+// The rest of the tests build argh the default way; only these see it with ARGH_STATS
+#define ARGH_STATS
+#include "../argh.h"
+
+uint64_t fakeAllocations = 0;
+uint64_t countAllocations() { return fakeAllocations += 2; }
+
+namespace test
+{
+	TEST_CLASS(ArghStatsTest)
+	{
+	public:
+		
+    TEST_METHOD(Stats)
+    {
+      Argh argh;
+      int i;
+      bool flag;
+      argh.addOption<int>(i, 0, "--intvalue");
+      argh.addFlag(flag, "--flag");
+      std::vector<ArghStats::Phase> phases;
+      argh.setStatsCallback([&](ArghStats::Phase phase, ArghStats const&) { phases.push_back(phase); });
+      argh.setAllocationCounter(countAllocations);
+      const int argc = 4;
+      char const* argv[argc] = { "--intvalue", "5", "--flag", "x" };
+      argh.parse(argc, argv);
+      argh.load("../argh.opts");
+      argh.getUsage();
+
+      auto const& stats = argh.getStats();
+      Assert::IsTrue(phases == std::vector<ArghStats::Phase>({ ArghStats::Parse, ArghStats::Load, ArghStats::Usage }));
+      Assert::AreEqual<uint64_t>(stats.calls[ArghStats::Load], 1);
+      Assert::AreEqual<uint64_t>(stats.options_matched, 3);
+      Assert::AreEqual<uint64_t>(stats.values_converted, 3);
+      std::ifstream ifs("../argh.opts", std::ios::binary | std::ios::ate);
+      Assert::AreEqual<uint64_t>(stats.bytes_tokenized, 18 + static_cast<uint64_t>(ifs.tellg()));
+      Assert::AreEqual<uint64_t>(stats.allocations, 6);
+      Assert::IsTrue(stats.arena_bytes > 0);
+      Assert::IsTrue(std::string(ArghStats::phaseName(ArghStats::ParseEnv)) == "parseEnv");
+      argh.resetStats();
+      Assert::AreEqual<uint64_t>(argh.getStats().options_matched, 0);
+    }
+	};
+}
@@ -5,6 +5,49 @@ using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 #include "../argh.h"
 
+#include <atomic>
+#include <thread>
+
+struct Point {
+  int x, y;
+};
+
+template<>
+struct Converter<Point> {
+  static void convert(std::string_view str, Point& val) {
+    auto comma = str.find(':');
+    Converter<int>::convert(str.substr(0, comma), val.x);
+    Converter<int>::convert(str.substr(comma + 1), val.y);
+  }
+};
+
+std::ostream& operator<<(std::ostream& os, Point const& p) { return os << p.x << ":" << p.y; }
+
+struct Counted {
+  int value;
+  static int conversions;
+};
+
+int Counted::conversions = 0;
+
+template<>
+struct Converter<Counted> {
+  static void convert(std::string_view str, Counted& val) {
+    ++Counted::conversions;
+    Converter<int>::convert(str, val.value);
+  }
+};
+
+std::ostream& operator<<(std::ostream& os, Counted const& c) { return os << c.value; }
+
+void setEnv(char const* name, char const* value) {
+#if defined(_WIN32)
+  _putenv_s(name, value);
+#else
+  setenv(name, value, 1);
+#endif
+}
+
 namespace test
 {		
 	TEST_CLASS(ArghTest)
@@ -26,6 +69,127 @@ namespace test
       Assert::IsTrue(i1 == 123);
     }
 
+    TEST_METHOD(LoadCrlfFile)
+    {
+      {
+        std::ofstream ofs("crlf.opts", std::ios::binary);
+        ofs << "--intvalue\r\n 456\r\n--stringvalue\r\nWindows line";
+      }
+      Argh argh;
+      int i1;
+      std::string s;
+      argh.addOption<int>(i1, 789, "--intvalue");
+      argh.addOption<std::string>(s, "", "--stringvalue");
+      Assert::IsTrue(argh.load("crlf.opts"));
+      Assert::IsTrue(i1 == 456);
+      Assert::IsTrue(s == "Windows line");
+      std::ofstream("crlf.opts", std::ios::trunc);
+      Assert::IsTrue(argh.load("crlf.opts"));
+      std::remove("crlf.opts");
+    }
+
+    TEST_METHOD(LoadStream)
+    {
+      Argh argh;
+      int i1;
+      std::vector<std::string> multi;
+      argh.addOption<int>(i1, 789, "--intvalue");
+      argh.addMultiOption<std::string>(multi, "", "--multistringvalue");
+      std::ifstream ifs("../argh.opts");
+      Assert::IsTrue(argh.load(ifs));
+      Assert::IsTrue(i1 == 123);
+      Assert::AreEqual<size_t>(multi.size(), 3);
+    }
+
+    TEST_METHOD(LoadChunks)
+    {
+      Argh argh;
+      int i1, i2;
+      argh.addOption<int>(i1, 789, "--intvalue");
+      argh.addOption<int>(i2, 0, "--last");
+      Argh::Loader loader(argh);
+      std::string text = "--intvalue\r\n456\n--last\n12";
+      for (size_t i = 0; i < 16; ++i) {
+        loader.write(text.substr(i, 1));
+      }
+      Assert::IsTrue(i1 == 456);
+      Assert::IsFalse(argh.isParsed("--last"));
+      loader.write(text.substr(16));
+      Assert::IsTrue(i2 == 0);
+      loader.finish();
+      Assert::IsTrue(i2 == 12);
+
+      // A stream that hands out one line per read, like a slow pipe: each line is applied before the next is asked for
+      struct Trickle : std::streambuf {
+        std::vector<std::string> lines;
+        size_t next = 0;
+        std::vector<int> seen;
+        int* value = nullptr;
+
+        int_type underflow() {
+          if (next == lines.size()) { return traits_type::eof(); }
+          seen.push_back(*value);
+          auto& line = lines[next++];
+          setg(&line[0], &line[0], &line[0] + line.size());
+          return traits_type::to_int_type(line[0]);
+        }
+      } trickle;
+      trickle.lines = { "--intvalue\n", "5\n", "--last\n", "6" };
+      trickle.value = &i1;
+      std::istream is(&trickle);
+      Assert::IsTrue(argh.load(is));
+      Assert::IsTrue(trickle.seen == std::vector<int>({ 456, 456, 5, 5 }));
+      Assert::IsTrue(i2 == 6);
+    }
+
+    TEST_METHOD(Snapshot)
+    {
+      int i1;
+      bool flag;
+      std::string s;
+      std::vector<float> multi;
+      std::vector<std::string> strings;
+      std::vector<bool> bools;
+      auto options = [&](Argh& argh) {
+        argh.addOption<int>(i1, 789, "--intvalue");
+        argh.addFlag(flag, "--flagvalue");
+        argh.addOption<std::string>(s, "", "--stringvalue");
+        argh.addMultiOption<float>(multi, "", "--multivalue");
+        argh.addMultiOption<std::string>(strings, "", "--multistringvalue");
+        argh.addMultiOption<bool>(bools, "1,0,1", "--bools");
+      };
+      {
+        Argh argh;
+        options(argh);
+        argh.load("../argh.opts");
+        char const* argv[2] = { "--bools", "0,1" };
+        argh.parse(2, argv);
+        Assert::IsTrue(argh.saveSnapshot("argh.snap"));
+      }
+      {
+        Argh argh;
+        options(argh);
+        Assert::IsTrue(i1 == 789 && !flag && multi.empty());
+        Assert::IsTrue(argh.loadSnapshot("argh.snap"));
+        Assert::IsTrue(i1 == 123 && flag && s == "Hi there");
+        Assert::IsTrue(multi == std::vector<float>({ 7, 8, 9 }));
+        Assert::AreEqual<size_t>(strings.size(), 3);
+        Assert::IsTrue(bools == std::vector<bool>({ false, true }));
+        Assert::IsTrue(argh.isParsed("--multivalue"));
+      }
+      {
+        Argh argh;
+        double d;
+        options(argh);
+        argh.addOption<double>(d, 0.0, "--extra");
+        Assert::IsFalse(argh.loadSnapshot("argh.snap"));
+        Assert::IsFalse(argh.loadSnapshot("missing.snap"));
+        Assert::IsFalse(argh.loadSnapshot("../argh.opts"));
+        Assert::IsTrue(i1 == 789);
+      }
+      std::remove("argh.snap");
+    }
+
     TEST_METHOD(BadArgs)
     {
       Argh argh;
@@ -98,6 +262,46 @@ namespace test
       Assert::IsTrue(cl_and_file == 456);
     }
 
+    TEST_METHOD(LayeredSources)
+    {
+      Argh argh;
+      Counted cl_and_file, file_only;
+      bool flag;
+      std::vector<float> multi;
+      argh.addOption<Counted>(cl_and_file, Counted{ 0 }, "--intvalue");
+      argh.addOption<Counted>(file_only, Counted{ 0 }, "--stringvalue");
+      argh.addFlag(flag, "--flagvalue");
+      argh.addMultiOption<float>(multi, "", "--multivalue");
+      const int argc = 4;
+      char const* argv[argc] = { "--intvalue", "456", "--multivalue", "1,2" };
+      Counted::conversions = 0;
+      argh.stage(2);
+      argh.parse(argc, argv);
+      argh.stage(1);
+      argh.load("../argh.opts");
+      Assert::IsTrue(Counted::conversions == 0);
+      Assert::IsFalse(argh.isParsed("--intvalue"));
+      argh.resolve();
+      Assert::IsTrue(Counted::conversions == 2);
+      Assert::IsTrue(cl_and_file.value == 456);
+      Assert::IsTrue(flag && argh.isParsed("--flagvalue"));
+      Assert::IsTrue(multi == std::vector<float>({ 1, 2 }));
+
+      argh.stage(1);
+      argh.parse(2, argv);
+      argh.resolve();
+      Assert::IsTrue(Counted::conversions == 3);
+
+      // Options can still be added while staging
+      int late;
+      argh.stage(1);
+      argh.addOption<int>(late, 0, "--late");
+      char const* late_argv[2] = { "--late", "9" };
+      argh.parse(2, late_argv);
+      argh.resolve();
+      Assert::AreEqual(late, 9);
+    }
+
     TEST_METHOD(MultiFile)
     {
       std::vector<float> multi;
@@ -120,5 +324,780 @@ namespace test
       Assert::IsTrue(complex.front() == "o n e");
       Assert::IsTrue(argh.isParsed("--complex"));
     }
+
+    TEST_METHOD(ManyOptions)
+    {
+      Argh argh;
+      std::vector<int> values(300);
+      std::vector<std::string> names;
+      for (size_t i = 0; i < values.size(); ++i) {
+        names.push_back("--option" + std::to_string(i));
+      }
+      for (size_t i = 0; i < values.size(); ++i) {
+        argh.addOption<int>(values[i], static_cast<int>(i), names[i]);
+      }
+      const int argc = 4;
+      char const* argv[argc] = { "--option7", "70", "--option299", "2990" };
+      argh.parse(argc, argv);
+      Assert::IsTrue(values[0] == 0);
+      Assert::IsTrue(values[7] == 70);
+      Assert::IsTrue(values[299] == 2990);
+      Assert::IsTrue(argh.isParsed("--option7"));
+      Assert::IsFalse(argh.isParsed("--option8"));
+      Assert::IsFalse(argh.isParsed("--option300"));
+    }
+
+    TEST_METHOD(NamesOutliveArguments)
+    {
+      Argh argh;
+      int i1;
+      {
+        std::string name = "--intvalue";
+        std::string msg = "Integer value";
+        argh.addOption<int>(i1, 789, name, false, msg);
+      }
+      const int argc = 2;
+      char const* argv[argc] = { "--intvalue", "456" };
+      argh.parse(argc, argv);
+      Assert::IsTrue(i1 == 456);
+      Assert::IsTrue(argh.isParsed("--intvalue"));
+      Assert::IsTrue(argh.getUsage().find("Integer value") != std::string::npos);
+    }
+
+    TEST_METHOD(Conversions)
+    {
+      Argh argh;
+      int i;
+      unsigned long long u;
+      double d;
+      bool b1, b2;
+      Point p;
+      std::vector<int> multi;
+      argh.addOption<int>(i, 0, "--int");
+      argh.addOption<unsigned long long>(u, 0, "--ull");
+      argh.addOption<double>(d, 0.0, "--double");
+      argh.addOption<bool>(b1, false, "--bool1");
+      argh.addOption<bool>(b2, true, "--bool2");
+      argh.addOption<Point>(p, Point{ 1, 2 }, "--point");
+      argh.addMultiOption<int>(multi, "", "--multi");
+      const int argc = 14;
+      char const* argv[argc] = { "--int", " +42", "--ull", "18446744073709551615", "--double", "-1.5e3",
+        "--bool1", "true", "--bool2", "0", "--point", "3:4", "--multi", "1,x,3" };
+      argh.parse(argc, argv);
+      Assert::IsTrue(i == 42);
+      Assert::IsTrue(u == 18446744073709551615ull);
+      Assert::IsTrue(d == -1500.0);
+      Assert::IsTrue(b1);
+      Assert::IsFalse(b2);
+      Assert::IsTrue(p.x == 3 && p.y == 4);
+      Assert::AreEqual<size_t>(multi.size(), 3);
+      Assert::IsTrue(multi[1] == 0 && multi[2] == 3);
+
+      // Out of range saturates and unsigned wraps, as stream extraction does
+      float f;
+      argh.addOption<float>(f, 0.f, "--float");
+      char const* range[8] = { "--int", "-99999999999", "--ull", "-1", "--double", "-1e999", "--float", "1e-60" };
+      argh.parse(8, range);
+      Assert::IsTrue(i == std::numeric_limits<int>::lowest());
+      Assert::IsTrue(u == 18446744073709551615ull);
+      Assert::IsTrue(d == std::numeric_limits<double>::lowest());
+      Assert::IsTrue(f == 0.f);
+      char const* more[4] = { "--int", "99999999999", "--ull", "+-1" };
+      argh.parse(4, more);
+      Assert::IsTrue(i == std::numeric_limits<int>::max());
+      Assert::IsTrue(u == 0);
+
+      // Bools read the whole token: true or false, or else a number
+      for (auto text : { "1", " true", "01", "2", "10", "-1", "1abc" }) {
+        Converter<bool>::convert(text, b1);
+        Assert::IsTrue(b1);
+      }
+      for (auto text : { "0", "false", "truex", "00", "x", "", "true1" }) {
+        Converter<bool>::convert(text, b1);
+        Assert::IsFalse(b1);
+      }
+    }
+
+    TEST_METHOD(LongMultiList)
+    {
+      std::string list;
+      std::vector<std::string> expected;
+      for (int i = 0; i < 1000; ++i) {
+        std::string field = (i % 7 == 3) ? "" : std::to_string(i * 37);
+        expected.push_back(field);
+        list += field + (i + 1 < 1000 ? "," : "");
+      }
+      Argh argh;
+      std::vector<int> ints;
+      std::vector<std::string> strings;
+      argh.addMultiOption<int>(ints, "", "--ints");
+      argh.addMultiOption<std::string>(strings, "", "--strings");
+      const int argc = 4;
+      char const* argv[argc] = { "--ints", list.c_str(), "--strings", list.c_str() };
+      argh.parse(argc, argv);
+      Assert::IsTrue(strings == expected);
+      Assert::AreEqual<size_t>(ints.size(), expected.size());
+      Assert::IsTrue(ints[3] == 0 && ints[999] == 999 * 37);
+    }
+
+    TEST_METHOD(EnvExactNames)
+    {
+      setEnv("--envvalue", "42");
+      Argh argh;
+      int i1, i2;
+      argh.addOption<int>(i1, 0, "--envvalue");
+      argh.addOption<int>(i2, 7, "--notinenv");
+      argh.parseEnv();
+      Assert::IsTrue(i1 == 42);
+      Assert::IsTrue(i2 == 7);
+      Assert::IsTrue(argh.isParsed("--envvalue"));
+      Assert::IsFalse(argh.isParsed("--notinenv"));
+    }
+
+    TEST_METHOD(EnvPrefixedNames)
+    {
+      setEnv("ARGHTEST_FOO_BAR", "1,2,3");
+      setEnv("ARGHTEST_VERBOSE", "1");
+      setEnv("FOO_BAR", "4,5");
+      Argh argh;
+      std::vector<int> foo_bar;
+      bool verbose;
+      argh.addMultiOption<int>(foo_bar, "", "--foo-bar");
+      argh.parseEnv("ARGHTEST_");
+      argh.addFlag(verbose, "--verbose");
+      argh.parseEnv("ARGHTEST_");
+      Assert::AreEqual<size_t>(foo_bar.size(), 3);
+      Assert::IsTrue(verbose);
+      argh.parseEnv("");
+      Assert::AreEqual<size_t>(foo_bar.size(), 2);
+    }
+
+    TEST_METHOD(SharedSchema)
+    {
+      Argh argh;
+      int i1;
+      bool flag;
+      std::vector<int> multi;
+      argh.addOption<int>(i1, 789, "--intvalue");
+      argh.addFlag(flag, "--flag");
+      argh.addMultiOption<int>(multi, "1,2", "--multi");
+
+      std::vector<std::thread> threads;
+      std::vector<int> failures(8, 0);
+      for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&argh, &failures, t] {
+          for (int n = 0; n < 100; ++n) {
+            std::string value = std::to_string(t * 1000 + n);
+            std::string list = value + "," + value;
+            const int argc = 4;
+            char const* argv[argc] = { "--intvalue", value.c_str(), "--multi", list.c_str() };
+            ArghResult result(argh);
+            argh.parse(result, t % 2 ? argc : 2, argv);
+            auto multi = result.get<std::vector<int>>("--multi");
+            bool ok = *result.get<int>("--intvalue") == t * 1000 + n
+              && result.isParsed("--intvalue") && !result.isParsed("--flag") && !*result.get<bool>("--flag")
+              && multi->size() == 2 && (*multi)[1] == (t % 2 ? t * 1000 + n : 2)
+              && result.get<float>("--intvalue") == nullptr && result.get<int>("--unknown") == nullptr;
+            failures[t] += ok ? 0 : 1;
+          }
+        });
+      }
+      for (auto& thread : threads) { thread.join(); }
+      Assert::IsTrue(std::count(failures.begin(), failures.end(), 0) == 8);
+      Assert::IsTrue(i1 == 789);
+      Assert::IsFalse(argh.isParsed("--intvalue"));
+
+      // A result made before an option was added still takes it
+      ArghResult early(argh);
+      double d;
+      argh.addOption<double>(d, 0.5, "--late");
+      Assert::IsTrue(early.get<double>("--late") == nullptr);
+      char const* argv[2] = { "--late", "2.5" };
+      argh.parse(early, 2, argv);
+      Assert::AreEqual(*early.get<double>("--late"), 2.5);
+      Assert::IsTrue(early.isParsed("--late"));
+    }
+
+    TEST_METHOD(BatchParse)
+    {
+      Argh argh;
+      int i;
+      bool b, flag;
+      std::string str;
+      std::vector<float> multi;
+      argh.addOption<int>(i, 7, "--intvalue");
+      argh.addOption<bool>(b, false, "--boolvalue");
+      argh.addOption<std::string>(str, "Default", "--stringvalue");
+      argh.addMultiOption<float>(multi, "1,2", "--multivalue");
+      argh.addFlag(flag, "--flag");
+
+      std::vector<std::string_view> tokens = {
+        "--intvalue", "1", "--flag",
+        "--multivalue", "3,4,5", "--boolvalue", "true",
+        "--stringvalue", "Hi", "--intvalue", "2", "--intvalue", "3",
+      };
+      std::vector<size_t> offsets = { 0, 3, 7, 7, 13 };
+      ArghBatch batch(argh);
+      argh.parse(batch, tokens, offsets);
+
+      Assert::AreEqual<size_t>(batch.size(), 4);
+      Assert::IsTrue(*batch.column<int>("--intvalue") == std::vector<int>({ 1, 7, 7, 3 }));
+      Assert::IsTrue(*batch.column<bool>("--boolvalue") == std::vector<bool>({ false, true, false, false }));
+      Assert::IsTrue(*batch.column<std::string>("--stringvalue") == std::vector<std::string>({ "Default", "Default", "Default", "Hi" }));
+      Assert::IsTrue((*batch.column<std::vector<float>>("--multivalue"))[1] == std::vector<float>({ 3.f, 4.f, 5.f }));
+      Assert::IsTrue((*batch.column<std::vector<float>>("--multivalue"))[2] == std::vector<float>({ 1.f, 2.f }));
+      Assert::IsTrue(*batch.column<bool>("--flag") == std::vector<bool>({ true, false, false, false }));
+      Assert::IsTrue(*batch.getParsed("--intvalue") == std::vector<bool>({ true, false, false, true }));
+      Assert::IsTrue(batch.isParsed("--boolvalue", 1));
+      Assert::IsFalse(batch.isParsed("--nothing", 1));
+      Assert::IsTrue(batch.column<float>("--intvalue") == nullptr);
+      Assert::AreEqual(i, 7);
+      Assert::IsFalse(flag);
+    }
+
+    TEST_METHOD(ResponseFiles)
+    {
+      {
+        std::ofstream ofs("outer.rsp", std::ios::binary);
+        ofs << "--intvalue\r\n@inner.rsp\r\n--flag\r\n";
+        std::ofstream ifs("inner.rsp", std::ios::binary);
+        ifs << "5";
+      }
+      Argh argh;
+      int i;
+      bool flag;
+      std::string s;
+      argh.addOption<int>(i, 0, "--intvalue");
+      argh.addFlag(flag, "--flag");
+      argh.addOption<std::string>(s, "", "--stringvalue");
+      argh.setResponseFiles(true);
+      const int argc = 3;
+      char const* argv[argc] = { "@outer.rsp", "--stringvalue", "@missing.rsp" };
+      argh.parse(argc, argv);
+      Assert::AreEqual(i, 5);
+      Assert::IsTrue(flag);
+      Assert::IsTrue(s == "@missing.rsp");
+
+      ArghResult result(argh);
+      argh.parse(result, argc, argv);
+      Assert::AreEqual(*result.get<int>("--intvalue"), 5);
+
+      {
+        std::ofstream ifs("inner.rsp", std::ios::binary);
+        ifs << "12";
+      }
+      argh.parse(argc, argv);
+      Assert::AreEqual(i, 12);
+      ResponseFile::clearCache();
+
+      // Uncached files are gone once parsed, but views held by a result still point into them
+      std::vector<std::string_view> views;
+      argh.addMultiOption<std::string_view>(views, "", "--views");
+      {
+        std::ofstream ofs("views.rsp", std::ios::binary);
+        ofs << "--views\nleft,right\n";
+      }
+      argh.setResponseFiles(true, false);
+      ArghResult viewed(argh);
+      char const* view_argv[1] = { "@views.rsp" };
+      argh.parse(viewed, 1, view_argv);
+      Assert::IsTrue(*viewed.get<std::vector<std::string_view>>("--views") == std::vector<std::string_view>({ "left", "right" }));
+
+      // Cached files are copies, so rewriting or truncating the file leaves the views alone
+      argh.setResponseFiles(true);
+      ArghResult cached(argh);
+      argh.parse(cached, 1, view_argv);
+      { std::ofstream ofs("views.rsp", std::ios::binary | std::ios::trunc); ofs << "--views\nXXXX,XXXXX\n"; }
+      { std::ofstream ofs("views.rsp", std::ios::binary | std::ios::trunc); }
+      Assert::IsTrue(*cached.get<std::vector<std::string_view>>("--views") == std::vector<std::string_view>({ "left", "right" }));
+      std::remove("views.rsp");
+      ResponseFile::clearCache();
+      std::remove("outer.rsp");
+      std::remove("inner.rsp");
+    }
+
+    TEST_METHOD(Reload)
+    {
+      Argh argh;
+      int i;
+      std::string s;
+      std::vector<std::string> multi;
+      argh.addOption<int>(i, 1, "--intvalue");
+      argh.addOption<std::string>(s, "Default", "--stringvalue");
+      argh.addMultiOption<std::string>(multi, "", "--multistringvalue");
+      {
+        std::ofstream ofs("reload.opts");
+        ofs << "--intvalue\n5\n--stringvalue\nHi\n--multistringvalue\na long enough string to live on the heap,b\n";
+      }
+      std::vector<std::string_view> changed;
+      auto record = [&](std::string_view name) { changed.push_back(name); };
+      Assert::IsTrue(argh.reload("reload.opts", record));
+      Assert::AreEqual<size_t>(changed.size(), 3);
+      auto data = multi[0].data();
+
+      {
+        std::ofstream ofs("reload.opts");
+        ofs << "--intvalue\n6\n--multistringvalue\na long enough string to live on the heap,b\n";
+      }
+      changed.clear();
+      Assert::IsTrue(argh.reload("reload.opts", record));
+      Assert::IsTrue(changed == std::vector<std::string_view>({ "--intvalue", "--stringvalue" }));
+      Assert::AreEqual(i, 6);
+      Assert::IsTrue(s == "Default");
+      Assert::IsFalse(argh.isParsed("--stringvalue"));
+      Assert::IsTrue(multi[0].data() == data);
+
+      {
+        // The callback runs on the watcher's thread, after the variables are written
+        std::atomic<bool> done(false);
+        ArghWatcher watcher(argh, "reload.opts", [&](std::string_view) { done = i == 77 && multi.empty(); }, std::chrono::milliseconds(10));
+        {
+          std::ofstream ofs("reload.opts");
+          ofs << "--intvalue\n77\n";
+        }
+        for (int tries = 0; tries < 500 && !done; ++tries) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+      }
+      Assert::AreEqual(i, 77);
+      Assert::IsTrue(multi.empty());
+
+#if defined(__linux__)
+      {
+        // Nothing is applied while the file is still open for writing
+        std::atomic<int> reloads(0);
+        ArghWatcher watcher(argh, "reload.opts", [&](std::string_view) { ++reloads; }, std::chrono::milliseconds(10));
+        std::ofstream ofs("reload.opts");
+        ofs << "--intvalue\n" << std::flush;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        Assert::AreEqual(reloads.load(), 0);
+        ofs << "88\n";
+        ofs.close();
+        for (int tries = 0; tries < 500 && reloads == 0; ++tries) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+      }
+      Assert::AreEqual(i, 88);
+#endif
+      std::remove("reload.opts");
+    }
+
+    TEST_METHOD(ResetBetweenParses)
+    {
+      Argh argh;
+      int i1;
+      bool flag;
+      std::string s;
+      std::vector<int> multi;
+      argh.addOption<int>(i1, 789, "--intvalue");
+      argh.addFlag(flag, "--flag");
+      argh.addOption<std::string>(s, "short", "--string");
+      argh.addMultiOption<int>(multi, "1,2", "--multi");
+      const int argc = 7;
+      char const* argv[argc] = { "--intvalue", "456", "--flag", "--string", "a much longer string value", "--multi", "1,2,3,4,5,6,7,8" };
+      argh.parse(argc, argv);
+      Assert::IsTrue(i1 == 456 && flag && multi.size() == 8);
+      auto multi_data = multi.data();
+      auto string_capacity = s.capacity();
+      argh.reset();
+      Assert::IsTrue(i1 == 789);
+      Assert::IsFalse(flag);
+      Assert::IsTrue(s == "short");
+      Assert::IsTrue(multi == std::vector<int>({ 1, 2 }));
+      Assert::IsTrue(multi.data() == multi_data);
+      Assert::IsTrue(s.capacity() == string_capacity);
+      Assert::IsFalse(argh.isParsed("--intvalue"));
+
+      ArghResult result(argh);
+      argh.parse(result, argc, argv);
+      Assert::IsTrue(*result.get<int>("--intvalue") == 456 && *result.get<bool>("--flag"));
+      result.reset();
+      Assert::IsTrue(*result.get<int>("--intvalue") == 789 && !*result.get<bool>("--flag"));
+      Assert::IsTrue(*result.get<std::vector<int>>("--multi") == std::vector<int>({ 1, 2 }));
+      Assert::IsFalse(result.isParsed("--multi"));
+    }
+
+    TEST_METHOD(UsageLayout)
+    {
+      Argh argh;
+      bool help;
+      int i1;
+      std::vector<std::string> multi;
+      argh.addFlag(help, "--help", "Display this message");
+      argh.addOption<int>(i1, 123, "--intvalue", true);
+      argh.addMultiOption<std::string>(multi, "one,two", "--multi", false, "List");
+      std::string expected =
+        "--help" + std::string(15, ' ') + "Display this message NOT REQUIRED\n"
+        "--intvalue 123       " + std::string(21, ' ') + "REQUIRED\n"
+        "--multi    \"one,two\" List" + std::string(17, ' ') + "NOT REQUIRED\n";
+      Assert::IsTrue(argh.getUsage() == expected);
+      std::stringstream ss;
+      argh.printUsage(ss);
+      Assert::IsTrue(ss.str() == expected);
+    }
+
+    TEST_METHOD(CachedDefaults)
+    {
+      float f;
+      std::vector<int> multi;
+      OptionImpl<float> option(f, 3.14f, "--floatvalue", false, "");
+      MultiOptionImpl<int> multi_option(multi, "1,2", "--multi", false, "", ',');
+      auto rendered = option.getDefault();
+      Assert::IsTrue(rendered == "3.14");
+      Assert::IsTrue(option.getDefault().data() == rendered.data());
+      Assert::IsTrue(multi_option.getDefault() == "\"1,2\"");
+    }
+
+    TEST_METHOD(Handles)
+    {
+      Argh argh;
+      int i;
+      bool flag;
+      std::string str;
+      std::vector<float> multi;
+      auto ih = argh.addOption<int>(i, 3, "--intvalue");
+      auto sh = argh.addOption<std::string>(str, "Default", "--stringvalue");
+      auto mh = argh.addMultiOption<float>(multi, "1", "--multivalue");
+      auto fh = argh.addFlag(flag, "--flag");
+      const int argc = 5;
+      char const* argv[argc] = { "--intvalue", "4", "--multivalue", "5,6", "--flag" };
+      argh.parse(argc, argv);
+      Assert::IsTrue(argh.isParsed(ih) && argh.isParsed(mh) && argh.isParsed(fh));
+      Assert::IsFalse(argh.isParsed(sh));
+      Assert::AreEqual(argh.get(ih), 4);
+      Assert::IsTrue(argh.get(sh) == "Default");
+      Assert::IsTrue(argh.get(mh) == std::vector<float>({ 5.f, 6.f }));
+      Assert::IsTrue(argh.get(fh));
+      argh.reset(mh);
+      Assert::IsFalse(argh.isParsed(mh));
+      Assert::IsTrue(multi == std::vector<float>({ 1.f }));
+
+      ArghResult result(argh);
+      char const* other[2] = { "--stringvalue", "Hi" };
+      argh.parse(result, 2, other);
+      Assert::IsTrue(result.isParsed(sh));
+      Assert::IsTrue(result.get(sh) == "Hi");
+      Assert::AreEqual(result.get(ih), 3);
+    }
+
+    TEST_METHOD(Commands)
+    {
+      Argh argh;
+      bool verbose;
+      int jobs = 0, level = 0, built = 0;
+      argh.addFlag(verbose, "--verbose");
+      argh.addCommand("build", [&](Argh& build) {
+        ++built;
+        build.addOption<int>(jobs, 1, "--jobs");
+      }, "Compile things");
+      argh.addCommand("clean", [&](Argh& clean) {
+        ++built;
+        clean.addOption<int>(level, 0, "--level");
+      });
+      const int argc = 5;
+      char const* argv[argc] = { "program", "--verbose", "build", "--jobs", "8" };
+      argh.parse(argc, argv);
+      Assert::IsTrue(verbose);
+      Assert::AreEqual(built, 1);
+      Assert::AreEqual(jobs, 8);
+      Assert::IsTrue(argh.getCommandName() == "build");
+      Assert::IsTrue(argh.getCommand()->isParsed("--jobs"));
+      Assert::IsFalse(argh.isParsed("--jobs"));
+
+      char const* again[3] = { "build", "--jobs", "2" };
+      argh.parse(3, again);
+      Assert::AreEqual(built, 1);
+      Assert::AreEqual(jobs, 2);
+
+      char const* none[1] = { "--verbose" };
+      argh.parse(1, none);
+      Assert::IsTrue(argh.getCommand() == nullptr);
+      Assert::IsTrue(argh.getCommandName().empty());
+      Assert::AreEqual(level, 0);
+
+      // A value that spells a command is still a value
+      std::string target;
+      argh.addOption<std::string>(target, "", "--target");
+      char const* value[4] = { "program", "--target", "build", "x" };
+      argh.parse(4, value);
+      Assert::IsTrue(argh.getCommand() == nullptr);
+      Assert::IsTrue(target == "build");
+
+      // Settings carry over to a command's options
+      Argh parent;
+      std::vector<double> list;
+      parent.setAbbreviations(true);
+      parent.setParallelThreshold(16, 2);
+      parent.addCommand("run", [&](Argh& run) { run.addMultiOption<double>(list, "", "--values"); });
+      std::string values = "1,2,3,4,5,6,7,8,9,10";
+      char const* abbreviated[3] = { "run", "--val", values.c_str() };
+      parent.parse(3, abbreviated);
+      Assert::AreEqual<size_t>(list.size(), 10);
+      Assert::AreEqual(list[9], 10.0);
+    }
+
+    TEST_METHOD(SchemaExport)
+    {
+      Argh argh;
+      int i;
+      bool flag;
+      std::string str;
+      std::vector<float> multi;
+      argh.addOption<int>(i, 123, "--intvalue", true, "Integer value");
+      argh.addOption<std::string>(str, "Say \"hi\"", "--stringvalue");
+      argh.addMultiOption<float>(multi, "1,2", "--multivalue");
+      argh.addFlag(flag, "--flag", "Tab\there");
+      auto json = argh.getSchemaJson();
+      Assert::IsTrue(json == "["
+        "{\"name\":\"--intvalue\",\"type\":\"int32\",\"default\":\"123\",\"required\":true,\"message\":\"Integer value\"},"
+        "{\"name\":\"--stringvalue\",\"type\":\"string\",\"default\":\"\\\"Say \\\"hi\\\"\\\"\",\"required\":false,\"message\":\"\"},"
+        "{\"name\":\"--multivalue\",\"type\":\"list<float32>\",\"default\":\"\\\"1,2\\\"\",\"required\":false,\"message\":\"\"},"
+        "{\"name\":\"--flag\",\"type\":\"flag\",\"default\":\"\",\"required\":false,\"message\":\"Tab\\u0009here\"}]");
+      Assert::IsTrue(argh.getSchemaJson().data() == json.data());
+
+      std::vector<SchemaEntry> entries;
+      Assert::IsTrue(Argh::readSchema(argh.getSchemaBinary(), entries));
+      Assert::AreEqual<size_t>(entries.size(), 4);
+      Assert::IsTrue(entries[0].required && entries[0].name == "--intvalue" && entries[0].default_val == "123");
+      Assert::IsTrue(entries[2].type == "list<float32>" && entries[3].msg == "Tab\there");
+      Assert::IsFalse(Argh::readSchema(argh.getSchemaBinary().substr(0, 40), entries));
+
+      argh.addOption<int>(i, 0, "--another");
+      Assert::IsTrue(Argh::readSchema(argh.getSchemaBinary(), entries));
+      Assert::AreEqual<size_t>(entries.size(), 5);
+    }
+
+    TEST_METHOD(LazyOptions)
+    {
+      Argh argh;
+      auto h = argh.addLazyOption<Counted>(Counted{ 4 }, "--counted");
+      auto d = argh.addLazyOption<double>(1.5, "--double");
+      Counted::conversions = 0;
+      const int argc = 4;
+      char const* argv[argc] = { "--counted", "5", "--counted", "6" };
+      argh.parse(argc, argv);
+      Assert::AreEqual(Counted::conversions, 0);
+      Assert::IsTrue(argh.isParsed(h));
+      Assert::AreEqual(argh.get(h).value, 6);
+      Assert::AreEqual(argh.get<Counted>("--counted")->value, 6);
+      Assert::AreEqual(Counted::conversions, 1);
+      Assert::AreEqual(argh.get(d), 1.5);
+      Assert::IsTrue(argh.get<int>("--double") == nullptr);
+
+      argh.parse(2, argv);
+      Assert::AreEqual(Counted::conversions, 1);
+      Assert::AreEqual(argh.get(h).value, 5);
+      argh.reset();
+      Assert::AreEqual(argh.get(h).value, 4);
+      Assert::AreEqual(Counted::conversions, 2);
+
+      // Columns of bool are std::vector<bool>, which only hands out proxies
+      Argh flags;
+      auto lazy = flags.addLazyOption<bool>(false, "--lazy");
+      std::vector<std::string_view> tokens = { "--lazy", "true", "--lazy", "false" };
+      std::vector<size_t> offsets = { 0, 2, 4 };
+      ArghBatch batch(flags);
+      flags.parse(batch, tokens, offsets);
+      Assert::IsTrue(*batch.column<bool>("--lazy") == std::vector<bool>({ true, false }));
+      char const* lazy_argv[2] = { "--lazy", "true" };
+      flags.parse(2, lazy_argv);
+      Assert::IsTrue(flags.get(lazy));
+    }
+
+    TEST_METHOD(ViewOverloads)
+    {
+      Argh argh;
+      int i;
+      std::vector<int> multi;
+      std::string name = "--intvalue";
+      std::string_view view = name;
+      argh.addOption<int>(i, 0, view, false, std::string_view("Message"));
+      argh.addMultiOption<int>(multi, std::string_view("1,2,3"), "--multivalue");
+      Assert::IsTrue(multi == std::vector<int>({ 1, 2, 3 }));
+      std::string path = "../argh.opts";
+      Assert::IsTrue(argh.load(std::string_view(path).substr(0, path.size())));
+      Assert::IsTrue(argh.isParsed(view.substr(0, 10)));
+      Assert::AreEqual(i, 123);
+      Assert::IsFalse(argh.load(std::string_view(std::string(300, 'x'))));
+
+      // The other functions taking a file name have the same overloads
+      std::string snap = "view.snap|";
+      Assert::IsTrue(argh.saveSnapshot(std::string_view(snap).substr(0, 9)));
+      i = 0;
+      Assert::IsTrue(argh.loadSnapshot(std::string_view(snap).substr(0, 9)));
+      Assert::AreEqual(i, 123);
+      Assert::IsFalse(argh.loadSnapshot(std::string_view(std::string(300, 'x'))));
+      std::remove("view.snap");
+      Assert::IsTrue(argh.reload(std::string_view(path).substr(0, path.size())));
+      Assert::IsTrue(argh.reload("../argh.opts"));
+    }
+
+    TEST_METHOD(RequiredBits)
+    {
+      Argh argh;
+      std::vector<int> values(150);
+      for (size_t i = 0; i < values.size(); ++i) {
+        argh.addOption<int>(values[i], 0, "--option" + std::to_string(i), i % 70 == 1);
+      }
+      const int argc = 4;
+      char const* argv[argc] = { "--option1", "1", "--option141", "2" };
+      argh.parse(argc, argv);
+      Assert::IsFalse(argh.hasAllRequired());
+      Assert::IsTrue(argh.missingRequired() == std::vector<std::string>{ "--option71" });
+      Assert::IsTrue(argh.isParsed("--option141"));
+      Assert::IsFalse(argh.isParsed("--option140"));
+
+      char const* rest[2] = { "--option71", "3" };
+      argh.parse(2, rest);
+      Assert::IsTrue(argh.hasAllRequired());
+      argh.reset();
+      Assert::IsFalse(argh.isParsed("--option1"));
+      Assert::AreEqual<size_t>(argh.missingRequired().size(), 3);
+    }
+
+    TEST_METHOD(StaticFrontEnd)
+    {
+      bool help;
+      int i1, i2;
+      std::string s;
+      std::vector<float> multi;
+      StaticArgh sargh(
+        StaticFlag(help, "--help", "Display this message"),
+        StaticOption<int>(i1, 789, "--intvalue", true, "Integer value"),
+        StaticOption<int>(i2, 5, "--other", true),
+        StaticOption<std::string>(s, "Old value", "--stringvalue"),
+        StaticMultiOption<float>(multi, "1.f,2.f", "--multivalue"));
+      Assert::IsTrue(i1 == 789 && s == "Old value");
+      Assert::AreEqual<size_t>(multi.size(), 2);
+      const int argc = 6;
+      char const* argv[argc] = { "--help", "--intvalue", "456", "--multivalue", "7,8,9", "--unknown" };
+      sargh.parse(argc, argv);
+      Assert::IsTrue(help);
+      Assert::IsTrue(i1 == 456);
+      Assert::AreEqual<size_t>(multi.size(), 3);
+      Assert::IsTrue(sargh.isParsed("--intvalue"));
+      Assert::IsFalse(sargh.isParsed("--stringvalue"));
+      Assert::IsFalse(sargh.isParsed("--unknown"));
+      Assert::IsTrue(sargh.missingRequired() == std::vector<std::string>{ "--other" });
+
+      Argh argh;
+      argh.addFlag(help, "--help", "Display this message");
+      argh.addOption<int>(i1, 789, "--intvalue", true, "Integer value");
+      argh.addOption<int>(i2, 5, "--other", true);
+      argh.addOption<std::string>(s, "Old value", "--stringvalue");
+      argh.addMultiOption<float>(multi, "1.f,2.f", "--multivalue");
+      Assert::IsTrue(sargh.getUsage() == argh.getUsage());
+
+      // Static options only view their text, so temporary strings don't compile
+      static_assert(!std::is_constructible<StaticOption<int>, int&, int, std::string>::value, "temporary name");
+      static_assert(!std::is_convertible<std::string, StaticText>::value, "temporary text");
+      std::string name = "--named";
+      StaticOption<int> named(i2, 3, name);
+      Assert::IsTrue(named.getName().data() == name.data());
+    }
+
+    TEST_METHOD(MultiStringReuse)
+    {
+      Argh argh;
+      std::vector<std::string> strings;
+      std::vector<std::string_view> views;
+      argh.addMultiOption<std::string>(strings, "", "--strings");
+      argh.addMultiOption<std::string_view>(views, "one,two", "--multistringvalue");
+      Assert::IsTrue(views == std::vector<std::string_view>({ "one", "two" }));
+      const int argc = 2;
+      char const* first[argc] = { "--strings", "a string too long for small buffers,x,y" };
+      char const* second[argc] = { "--strings", "a shorter string that fits in there" };
+      argh.parse(argc, first);
+      auto data = strings[0].data();
+      argh.parse(argc, second);
+      Assert::AreEqual<size_t>(strings.size(), 1);
+      Assert::IsTrue(strings[0] == "a shorter string that fits in there");
+      Assert::IsTrue(strings[0].data() == data);
+
+      argh.load("../argh.opts");
+      Assert::IsTrue(views == std::vector<std::string_view>({ "Here are some", "well", "\"delimited\" strings" }));
+
+      // The views' text is copied into one buffer per option, which a shorter value reuses
+      char const* long_views[argc] = { "--multistringvalue", "a list long enough to need the heap,b" };
+      char const* short_views[argc] = { "--multistringvalue", "c,d" };
+      argh.parse(argc, long_views);
+      auto text = views[0].data();
+      argh.parse(argc, short_views);
+      Assert::IsTrue(views == std::vector<std::string_view>({ "c", "d" }));
+      Assert::IsTrue(views[0].data() == text);
+    }
+
+    TEST_METHOD(ParallelLists)
+    {
+      std::string list;
+      for (int i = 0; i < 10000; ++i) {
+        list += std::to_string(i * 0.5) + (i % 7 ? "," : ",,");
+      }
+      for (auto text : { list, list.substr(0, list.size() - 2), std::string(",,,"), std::string("1") }) {
+        std::vector<double> serial, parallel;
+        assignList(serial, text, ',');
+        for (unsigned threads : { 2, 3, 8, 64 }) {
+          assignListParallel(parallel, text, ',', threads);
+          Assert::IsTrue(parallel == serial);
+        }
+      }
+
+      Argh argh;
+      std::vector<double> multi;
+      argh.addMultiOption<double>(multi, "", "--multivalue");
+      argh.setParallelThreshold(64, 4);
+      const int argc = 2;
+      char const* argv[argc] = { "--multivalue", list.c_str() };
+      argh.parse(argc, argv);
+      Assert::AreEqual<size_t>(multi.size(), 10000 + 10000 / 7 + 1);
+      Assert::AreEqual(multi[2], 0.5);
+      Assert::AreEqual(multi.back(), 9999 * 0.5);
+    }
+
+    TEST_METHOD(Abbreviations)
+    {
+      Argh argh;
+      int number, other;
+      bool flag;
+      argh.addOption<int>(number, 0, "--mynumber");
+      argh.addOption<int>(other, 0, "--myother");
+      argh.setAbbreviations(true);
+      argh.addFlag(flag, "--flag");
+      const int argc = 5;
+      char const* argv[argc] = { "--mynum", "5", "--my", "6", "--fl" };
+      argh.parse(argc, argv);
+      Assert::AreEqual(number, 5);
+      Assert::AreEqual(other, 0);
+      Assert::IsTrue(flag);
+
+      Assert::IsTrue(argh.completions("--my") == std::vector<std::string_view>({ "--mynumber", "--myother" }));
+      Assert::IsTrue(argh.suggest("--mynunber") == "--mynumber");
+      Assert::IsTrue(argh.suggest("--myothr") == "--myother");
+      Assert::IsTrue(argh.suggest("--falg") == "--flag");
+      Assert::IsTrue(argh.suggest("--completelydifferent").empty());
+    }
+
+    TEST_METHOD(ArenaUpstream)
+    {
+      char buffer[16384];
+      std::pmr::monotonic_buffer_resource pool(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+      int i1;
+      std::string s;
+      std::vector<float> multi;
+      bool flag;
+      {
+        Argh argh(',', &pool);
+        argh.addOption<int>(i1, 789, "--intvalue", false, "Integer value");
+        argh.addOption(s, "Old value", "--stringvalue");
+        argh.addMultiOption<float>(multi, "1.f,2.f", "--multivalue");
+        argh.addFlag(flag, "--flag");
+        const int argc = 3;
+        char const* argv[argc] = { "--intvalue", "456", "--flag" };
+        argh.parse(argc, argv);
+      }
+      Assert::IsTrue(i1 == 456);
+      Assert::IsTrue(flag);
+      Assert::AreEqual<size_t>(multi.size(), 2);
+    }
 	};
 }
\ No newline at end of file